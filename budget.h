@@ -0,0 +1,215 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+
+/* make yash-budget: the shell with counters on its allocations and syscalls, for
+   test_budget.c to hold the cost of each prompt to a budget.
+
+   malloc, calloc, realloc and free are replaced (glibc forwards to __libc_*), so
+   allocations made inside libc (stdio buffers, strdup, ...) are counted too. The
+   syscalls the shell makes itself are wrapped at link time (ld --wrap, see the
+   Makefile). Reads and writes are taken from the kernel's own counters instead,
+   which also see the ones stdio makes: syscr/syscw in /proc/thread-self/io (the
+   process-wide file adds in every child the shell has reaped).
+
+   With YASH_BUDGET=file in the environment, every prompt appends what the shell
+   did since the previous one, as one line:
+       calls 5 allocs 0 frees 0 read 1 write 1 poll 1 tcsetattr 1 tcsetpgrp 1 ...
+   Without YASH_BUDGET defined at compile time, report_Budget is a no-op. */
+
+#ifdef YASH_BUDGET
+
+#include <stdarg.h>			// va_list
+#include <stdio.h>			// snprintf
+#include <stdlib.h>			// getenv, atoll
+#include <string.h>			// strstr, memcpy
+#include <unistd.h>			// pread, write
+#include <fcntl.h>			// O_* (open)
+#include <poll.h>			// struct pollfd
+#include <termios.h>		// struct termios
+#include <sys/wait.h>		// wait4
+#include <sys/resource.h>	// struct rusage
+
+
+typedef enum
+{
+	Budget_fork, Budget_pipe, Budget_pipe2, Budget_dup2, Budget_waitpid, Budget_wait4,
+	Budget_tcsetpgrp, Budget_tcsetattr, Budget_poll, Budget_open, Budget_close, Budget_kill,
+	Budget_syscall, Budget_read, Budget_write,
+	BUDGET_CALLS
+} Budget_Call;
+
+static const char* budget_names[] =
+{
+	"fork", "pipe", "pipe2", "dup2", "waitpid", "wait4",
+	"tcsetpgrp", "tcsetattr", "poll", "open", "close", "kill",
+	"syscall", "read", "write"
+};
+
+static unsigned long long budget_calls[BUDGET_CALLS];
+static unsigned long long budget_allocs = 0, budget_frees = 0;
+
+
+/* Allocations */
+extern void* __libc_malloc (size_t size);
+extern void* __libc_calloc (size_t n, size_t size);
+extern void* __libc_realloc (void* ptr, size_t size);
+extern void __libc_free (void* ptr);
+
+void* malloc (size_t size)
+{
+	budget_allocs++;
+	return __libc_malloc(size);
+}
+
+void* calloc (size_t n, size_t size)
+{
+	budget_allocs++;
+	return __libc_calloc(n, size);
+}
+
+void* realloc (void* ptr, size_t size)
+{
+	budget_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+void free (void* ptr)
+{
+	budget_frees += (ptr != NULL);
+	__libc_free(ptr);
+}
+
+
+/* Syscalls (ld --wrap=name sends the shell's calls to __wrap_name) */
+pid_t __real_fork (void);
+int __real_pipe (int fds[2]);
+int __real_pipe2 (int fds[2], int flags);
+int __real_dup2 (int old, int new);
+pid_t __real_waitpid (pid_t pid, int* status, int options);
+pid_t __real_wait4 (pid_t pid, int* status, int options, struct rusage* usage);
+int __real_tcsetpgrp (int fd, pid_t pgid);
+int __real_tcsetattr (int fd, int when, const struct termios* t);
+int __real_poll (struct pollfd* fds, nfds_t n, int timeout);
+int __real_open (const char* path, int flags, ...);
+int __real_close (int fd);
+int __real_kill (pid_t pid, int sig);
+long __real_syscall (long number, ...);
+
+pid_t __wrap_fork (void) { budget_calls[Budget_fork]++; return __real_fork(); }
+int __wrap_pipe (int fds[2]) { budget_calls[Budget_pipe]++; return __real_pipe(fds); }
+int __wrap_pipe2 (int fds[2], int flags) { budget_calls[Budget_pipe2]++; return __real_pipe2(fds, flags); }
+int __wrap_dup2 (int old, int new) { budget_calls[Budget_dup2]++; return __real_dup2(old, new); }
+pid_t __wrap_waitpid (pid_t pid, int* status, int options) { budget_calls[Budget_waitpid]++; return __real_waitpid(pid, status, options); }
+pid_t __wrap_wait4 (pid_t pid, int* status, int options, struct rusage* usage) { budget_calls[Budget_wait4]++; return __real_wait4(pid, status, options, usage); }
+int __wrap_tcsetpgrp (int fd, pid_t pgid) { budget_calls[Budget_tcsetpgrp]++; return __real_tcsetpgrp(fd, pgid); }
+int __wrap_tcsetattr (int fd, int when, const struct termios* t) { budget_calls[Budget_tcsetattr]++; return __real_tcsetattr(fd, when, t); }
+int __wrap_poll (struct pollfd* fds, nfds_t n, int timeout) { budget_calls[Budget_poll]++; return __real_poll(fds, n, timeout); }
+int __wrap_close (int fd) { budget_calls[Budget_close]++; return __real_close(fd); }
+int __wrap_kill (pid_t pid, int sig) { budget_calls[Budget_kill]++; return __real_kill(pid, sig); }
+
+int __wrap_open (const char* path, int flags, ...)
+{
+	va_list args;
+	va_start(args, flags);
+	int mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(args, int) : 0;
+	va_end(args);
+
+	budget_calls[Budget_open]++;
+	return __real_open(path, flags, mode);
+}
+
+/* clone, close_range, ioprio_set, ...: at most 6 arguments, all passed as longs */
+long __wrap_syscall (long number, ...)
+{
+	va_list args;
+	va_start(args, number);
+	long a[6];
+	for (int i=0; i < 6; i++)
+		a[i] = va_arg(args, long);
+	va_end(args);
+
+	budget_calls[Budget_syscall]++;
+	return __real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+
+/* The kernel's count of read and write calls so far (not counting this pread yet) */
+static void read_Budget_io (int fd, unsigned long long* reads, unsigned long long* writes)
+{
+	char buffer[512];
+	ssize_t bytes = pread(fd, buffer, sizeof(buffer) - 1, 0);
+	if (bytes <= 0)
+		return;
+	buffer[bytes] = 0;
+
+	char* field;
+	if ((field = strstr(buffer, "syscr: ")) != NULL)
+		*reads = atoll(field + 7);
+	if ((field = strstr(buffer, "syscw: ")) != NULL)
+		*writes = atoll(field + 7);
+}
+
+void report_Budget ()
+{
+	static int started = 0, log_fd = -1, io_fd = -1;
+	static unsigned long long last[BUDGET_CALLS], last_allocs, last_frees;
+
+	if (!started)
+	{
+		started = 1;
+		const char* path = getenv("YASH_BUDGET");
+		if (path == NULL)
+			return;
+		log_fd = __real_open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		io_fd = __real_open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+		if (log_fd == -1 || io_fd == -1)
+		{
+			perror("yash: budget");
+			log_fd = -1;
+			return;
+		}
+		memcpy(last, budget_calls, sizeof(last));
+		read_Budget_io(io_fd, &last[Budget_read], &last[Budget_write]);
+		last[Budget_read]++;	// this pread: counted once it returns
+		last_allocs = budget_allocs;
+		last_frees = budget_frees;
+		return;
+	}
+
+	if (log_fd == -1)
+		return;
+
+	unsigned long long now[BUDGET_CALLS];
+	memcpy(now, budget_calls, sizeof(now));
+	read_Budget_io(io_fd, &now[Budget_read], &now[Budget_write]);
+
+	unsigned long long total = 0;
+	for (int i=0; i < BUDGET_CALLS; i++)
+		total += now[i] - last[i];
+
+	/* snprintf into the stack: the report itself doesn't allocate */
+	char line[1024];
+	int len = snprintf(line, sizeof(line), "calls %llu allocs %llu frees %llu", total,
+		budget_allocs - last_allocs, budget_frees - last_frees);
+	for (int i=0; i < BUDGET_CALLS && len < (int) sizeof(line) - 32; i++)
+		if (now[i] != last[i])
+			len += snprintf(line + len, sizeof(line) - len, " %s %llu", budget_names[i], now[i] - last[i]);
+	line[len++] = '\n';
+	write(log_fd, line, len);
+
+	memcpy(last, now, sizeof(last));
+	last[Budget_read]++;		// this report's pread
+	last[Budget_write]++;		// and line
+	last_allocs = budget_allocs;
+	last_frees = budget_frees;
+}
+
+#else
+
+static inline void report_Budget () {}
+
+#endif /* YASH_BUDGET */
+
+
+#endif /* BUDGET_H */
@@ -0,0 +1,135 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+
+#include <stdio.h>			// fprintf
+#include <stdlib.h>			// exit
+#include <string.h>			// strcmp
+#include "tokenize.h"
+#include "parse_tokens.h"
+#include "job.h"
+#include "job_control.h"
+#include "queue.h"
+#include "parallel.h"
+#include "tasks.h"
+#include "options.h"
+#include "pipe_profile.h"
+#include "job_top.h"
+#include "stats.h"
+#include "explain.h"
+
+
+static const char* special[] = {"fg", "bg", "jobs", "exit", "kill", "wait", "queue", "parallel", "tasks", "set", "stats", "explain", NULL};
+
+
+int launch_builtin (char** tokens)
+{
+
+	/* Builtins that take arguments */
+	if(strcmp(tokens[0], special[4]) == 0)
+	{
+		set_args_end(tokens);
+		kill_builtin(tokens+1);
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[5]) == 0)
+	{
+		set_args_end(tokens);
+		wait_builtin(tokens+1);
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[6]) == 0)
+	{
+		char** command = queue_options(tokens+1);
+		if (command == NULL)
+			return 1;
+
+		if (no_tokens(command))
+		{
+			print_Queue();
+			return 1;
+		}
+
+		Job* j = make_Job(command);
+		if (j != NULL)
+		{
+			j->next = current_Job;
+			current_Job = j;
+			enqueue_Job(j);
+		}
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[7]) == 0)
+	{
+		if (parallel(tokens+1) == -1)
+			fprintf(stderr, "yash: parallel: usage: parallel [-j slots] [-n batch] [-k] [--tag] [-a file] cmd ... [{}] [::: item ...]\n");
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[8]) == 0)
+	{
+		if (run_Tasks(tokens+1) == -1)
+			fprintf(stderr, "yash: tasks: usage: tasks [-j cores] [file]\n");
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[9]) == 0)
+	{
+		set_args_end(tokens);
+		if (set_builtin(tokens+1) == -1)
+			fprintf(stderr, "yash: set: usage: set [-o option | +o option]...\n");
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[10]) == 0)
+	{
+		set_args_end(tokens);
+		if (stats_builtin(tokens+1) == -1)
+			fprintf(stderr, "yash: stats: usage: stats [-j] [-r]\n");
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[11]) == 0)
+	{
+		if (tokens[1] != NULL && get_token_index((char**) special, tokens[1]) != -1)
+			printf("%s: shell builtin, runs inside the shell (no fork, no exec)\n", tokens[1]);
+		else if (explain_Job(tokens+1) == -1)
+			fprintf(stderr, "yash: explain: usage: explain [time] [limit ... --] cmd ... [&] [&! watch ...]\n");
+		return 1;
+	}
+
+	else if(strcmp(tokens[0], special[2]) == 0 && tokens[1] != NULL && strcmp(tokens[1], "-l") == 0 && no_tokens(tokens+2))
+	{
+		print_Jobs_long();
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[2]) == 0 && tokens[1] != NULL && strcmp(tokens[1], "--profile") == 0)
+	{
+		set_args_end(tokens);
+		if (profile_Job(tokens+2) == -1)
+			fprintf(stderr, "yash: jobs: usage: jobs --profile [%%job] [-i interval] [-t duration]\n");
+		return 1;
+	}
+	else if(strcmp(tokens[0], special[2]) == 0 && tokens[1] != NULL && strcmp(tokens[1], "--top") == 0)
+	{
+		set_args_end(tokens);
+		if (top_Jobs(tokens+2) == -1)
+			fprintf(stderr, "yash: jobs: usage: jobs --top [-d interval] [-n count] [-s cpu|read|write|rss]\n");
+		return 1;
+	}
+
+	if (!no_tokens(tokens+1))
+		return 0;
+
+	if(strcmp(tokens[0], special[0]) == 0)
+		fg();
+	else if(strcmp(tokens[0], special[1]) == 0)
+		bg();
+	else if(strcmp(tokens[0], special[2]) == 0)
+		print_Jobs(1);
+	else if(strcmp(tokens[0], special[3]) == 0)
+		exit(0);
+	else
+		return 0;
+
+	return 1;
+}
+
+
+#endif /* BUILTINS_H */
@@ -0,0 +1,140 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+
+#include <poll.h>			// poll, struct pollfd
+#include <time.h>			// clock_gettime, CLOCK_MONOTONIC
+#include <errno.h>			// EINTR
+#include <stdio.h>			// fprintf
+#include <signal.h>			// sig_atomic_t
+
+#define MAX_EVENTS 256
+
+
+/* The shell's event loop: every fd it is waiting on (child state changes, timers, ...)
+   is registered here and multiplexed with a single poll(). */
+
+typedef void (*Event_handler) (int fd, short revents, void* data);
+
+typedef struct Event
+{
+	int fd;
+	short events;
+	Event_handler handler;
+	void* data;
+} Event;
+
+
+static Event event_list[MAX_EVENTS];
+static int event_count = 0;
+
+volatile sig_atomic_t interrupted = 0;	// set by the shell's SIGINT handler
+long long wake_ns = 0;					// when the last poll() returned
+
+
+long long get_monotonic_ns ()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (long long) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+int add_Event (int fd, short events, Event_handler handler, void* data)
+{
+	if (event_count == MAX_EVENTS)
+	{
+		fprintf(stderr, "yash: add_Event: too many events\n");
+		return -1;
+	}
+
+	event_list[event_count++] = (Event) {fd, events, handler, data};
+	return 0;
+}
+
+void remove_Event (int fd)
+{
+	for (int i=0; i < event_count; i++)
+		if (event_list[i].fd == fd)
+		{
+			event_list[i] = event_list[--event_count];
+			return;
+		}
+}
+
+static Event* find_Event (int fd)
+{
+	for (int i=0; i < event_count; i++)
+		if (event_list[i].fd == fd)
+			return &event_list[i];
+
+	return NULL;
+}
+
+/* Block until a registered fd is ready (dispatching its handler), timeout_ms passes,
+   or stop_fd (if not -1) becomes readable.
+   Returns 1 if stop_fd is readable, 0 otherwise, -1 on error (errno set, EINTR included). */
+int wait_Events (int timeout_ms, int stop_fd)
+{
+	struct pollfd fds[MAX_EVENTS+1];
+	int n = 0;
+
+	for (int i=0; i < event_count; i++)
+		fds[n++] = (struct pollfd) {event_list[i].fd, event_list[i].events, 0};
+	if (stop_fd != -1)
+		fds[n++] = (struct pollfd) {stop_fd, POLLIN, 0};
+
+	int ready = poll(fds, n, timeout_ms);
+	if (ready <= 0)
+		return ready;
+	wake_ns = get_monotonic_ns();
+
+	for (int i=0; i < n; i++)
+	{
+		if (fds[i].revents == 0 || fds[i].fd == stop_fd)
+			continue;
+
+		/* An earlier handler may have removed this one */
+		Event* e = find_Event(fds[i].fd);
+		if (e != NULL)
+			e->handler(e->fd, fds[i].revents, e->data);
+	}
+
+	return (stop_fd != -1 && fds[n-1].revents != 0);
+}
+
+
+#endif /* EVENTS_H */
+
+
+
+/* Test EVENTS */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <unistd.h>			// pipe, write, read
+
+static void on_read (int fd, short revents, void* data)
+{
+	char c[64];
+	ssize_t bytes = read(fd, c, sizeof(c));
+	printf("fd %d ready (%zd bytes), data: %s\n", fd, bytes, (char*) data);
+	remove_Event(fd);
+}
+
+int main(void)
+{
+	int fds[2];
+	pipe(fds);
+	add_Event(fds[0], POLLIN, on_read, "hello");
+
+	long long start = get_monotonic_ns();
+	printf("timeout: %d\n", wait_Events(100, -1));
+	printf("waited %lld ms\n", (get_monotonic_ns() - start) / 1000000);
+
+	write(fds[1], "x", 1);
+	printf("dispatched: %d\n", wait_Events(-1, -1));
+	printf("events left: %d\n", event_count);
+
+	return 0;
+}
+#endif
+/* Test EVENTS */
@@ -0,0 +1,406 @@
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include <sys/stat.h>		// stat, S_ISREG
+#include <unistd.h>			// access, X_OK
+#include <stdio.h>			// printf, snprintf
+#include <stdlib.h>			// getenv, free
+#include <string.h>			// strchr, strcmp
+#include "job.h"
+#include "job_limits.h"
+#include "watchdog.h"
+#include "options.h"
+#include "parse_tokens.h"
+#include "stats.h"
+#include "trace.h"
+
+
+/* explain [time] [limit ... --] cmd ... [&] [&! watch ...]
+
+   The launch plan of a command line, without launching it: the line goes through
+   make_Job as usual, except that redirect targets are noted rather than opened
+   (dry_run). For each stage: the program execvp would run (and how many execve
+   calls the PATH search takes to get there), and where its stdin, stdout and
+   stderr come from. For the job: how it is forked (one fork per stage, or the
+   supervisor's leader), its process group and who gets the terminal.
+
+   The syscall count is predicted by walking the same branches launch_Job and
+   launch_Process take with the current options; it covers the launch only (up to
+   every stage's execve), not waiting for the job. */
+
+typedef enum
+{
+	Sys_open, Sys_pipe2, Sys_fcntl, Sys_mmap, Sys_clone, Sys_setpgid, Sys_close, Sys_ioctl,
+	Sys_timerfd_create, Sys_timerfd_settime, Sys_getrusage, Sys_read, Sys_write,
+	Sys_sched_setscheduler, Sys_ioprio_set, Sys_sched_setaffinity, Sys_setpriority, Sys_setrlimit,
+	Sys_rt_sigaction, Sys_rt_sigprocmask, Sys_dup2, Sys_close_range, Sys_getpid, Sys_execve,
+	SYSCALL_KINDS
+} Syscall_Kind;
+
+static const char* syscall_names[] =
+{
+	"open", "pipe2", "fcntl", "mmap", "clone", "setpgid", "close", "ioctl",
+	"timerfd_create", "timerfd_settime", "getrusage", "read", "write",
+	"sched_setscheduler", "ioprio_set", "sched_setaffinity", "setpriority", "setrlimit",
+	"rt_sigaction", "rt_sigprocmask", "dup2", "close_range", "getpid", "execve"
+};
+
+typedef struct Syscall_Plan
+{
+	int count[SYSCALL_KINDS];
+} Syscall_Plan;
+
+
+static int sum_Plan (const Syscall_Plan* s)
+{
+	int total = 0;
+	for (int i=0; i < SYSCALL_KINDS; i++)
+		total += s->count[i];
+	return total;
+}
+
+static void print_Plan (const char* who, const Syscall_Plan* s)
+{
+	printf("  %-9s %3d ", who, sum_Plan(s));
+	const char* separator = " ";
+	for (int i=0; i < SYSCALL_KINDS; i++)
+		if (s->count[i] > 0)
+		{
+			printf("%s%s %d", separator, syscall_names[i], s->count[i]);
+			separator = ", ";
+		}
+	printf("\n");
+}
+
+/* What execvp would run: the first executable regular file along PATH. Returns how
+   many execve calls that takes (every one before it fails), with path set to "" if
+   none is found. */
+static int resolve_Program (const char* name, char* path, size_t size)
+{
+	struct stat st;
+
+	if (strchr(name, '/') != NULL)
+	{
+		snprintf(path, size, "%s", (access(name, X_OK) == 0 && stat(name, &st) == 0 && S_ISREG(st.st_mode)) ? name : "");
+		return 1;
+	}
+
+	const char* dirs = getenv("PATH");
+	if (dirs == NULL)
+		dirs = "/bin:/usr/bin";
+
+	int tries = 0;
+	for (const char* dir = dirs; ; dir++)
+	{
+		const char* end = strchr(dir, ':');
+		int len = (end != NULL) ? end - dir : (int) strlen(dir);
+		tries++;
+
+		if (len == 0) // an empty entry is the current directory
+			snprintf(path, size, "./%s", name);
+		else
+			snprintf(path, size, "%.*s/%s", len, dir, name);
+		if (access(path, X_OK) == 0 && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+			return tries;
+
+		if (end == NULL)
+			break;
+		dir = end;
+	}
+
+	path[0] = 0;
+	return tries;
+}
+
+/* One stage's side of launch_Process, and of its way there (held at the barrier, or
+   released by the leader) */
+static void plan_Stage (Job* j, Process* p, int stage, int stages, int supervised, int tracing, int execve_tries, Syscall_Plan* s)
+{
+	if (supervised && stage > 0)
+	{
+		s->count[Sys_close]++;			// report pipe
+		s->count[Sys_read]++;			// release
+	}
+	else if (!supervised)
+	{
+		s->count[Sys_rt_sigaction] += 2;		// ^C and ^Z back to the defaults
+		s->count[Sys_rt_sigprocmask]++;
+		s->count[Sys_close]++;			// barrier's write end
+		s->count[Sys_read]++;			// barrier
+	}
+
+	if (j->sched != Normal_Sched && !(supervised && stage > 0))
+	{
+		s->count[Sys_sched_setscheduler]++;
+		s->count[Sys_ioprio_set] += (j->sched != Batch_Sched);
+	}
+
+	s->count[Sys_rt_sigaction] += 7;
+	s->count[Sys_rt_sigprocmask]++;
+
+	int in = (p->redirect[0] != NULL) || stage > 0;
+	int out = (p->redirect[1] != NULL) || stage + 1 < stages;
+	int err = (p->redirect[2] != NULL);
+	s->count[Sys_dup2] += in + out + err;
+	s->count[Sys_close] += in + out + err;
+
+	s->count[Sys_close_range] += tracing ? 2 : 1;	// around the exec notification fd
+
+	const Limits* l = j->limits;
+	if (l != NULL)
+	{
+		s->count[Sys_sched_setaffinity] += l->has_cpus;
+		s->count[Sys_setpriority] += l->has_nice;
+		s->count[Sys_ioprio_set] += l->has_ioprio;
+		s->count[Sys_setrlimit] += l->n_rlimits;
+	}
+	if (placement_option && !(l != NULL && l->has_cpus) && !(j->foreground && stages == 1))
+		s->count[Sys_sched_setaffinity]++;	// place_Job pins it
+
+	s->count[Sys_getpid]++;				// exec stamp (stats.h)
+	s->count[Sys_write] += tracing;		// exec notification
+	s->count[Sys_execve] += execve_tries;
+}
+
+/* The shell's side of launch_Job (and make_Job's opens), and the leader's when supervised */
+static void plan_Shell (Job* j, int stages, int relays, int supervised, int tracing, const Watchdog* w, Syscall_Plan* shell, Syscall_Plan* leader)
+{
+	for (Process* p = j->p; p != NULL; p = p->next)
+		for (int i=0; i < 3; i++)
+			if (p->redirect[i] != NULL)
+			{
+				shell->count[Sys_open]++;
+				shell->count[Sys_close]++;	// close_Redirects after the fork
+			}
+
+	shell->count[Sys_getrusage]++;		// shell CPU at launch
+	shell->count[Sys_mmap] += (exec_slots == NULL);
+
+	if (supervised)
+	{
+		shell->count[Sys_pipe2] += 2;		// report, release
+		shell->count[Sys_clone]++;
+		shell->count[Sys_close] += 2;
+		shell->count[Sys_setpgid]++;
+
+		leader->count[Sys_setpgid]++;
+		leader->count[Sys_close] += 2;
+		leader->count[Sys_pipe2] += 1 + (stages - 2);
+		leader->count[Sys_clone] += stages - 1;
+		leader->count[Sys_close] += (stages - 1) + (stages - 2);
+		leader->count[Sys_write]++;		// pids
+		leader->count[Sys_close]++;
+	}
+	else
+	{
+		shell->count[Sys_pipe2] += 1 + (stages - 1) + relays;
+		shell->count[Sys_fcntl] += 4 * relays;	// O_NONBLOCK and F_SETPIPE_SZ on both of the shell's ends
+		shell->count[Sys_clone] += stages;
+		shell->count[Sys_setpgid] += stages;
+		shell->count[Sys_close] += 2 * (stages - 1) + 2;	// pipe ends handed over, barrier
+		shell->count[Sys_rt_sigprocmask] += 2 * stages;		// ^C and ^Z blocked across each fork
+		shell->count[Sys_ioctl] += (j->foreground && (interactive || script_terminal));	// tcsetpgrp
+
+		if (tracing)
+		{
+			shell->count[Sys_pipe2] += stages;	// exec notification
+			shell->count[Sys_close] += stages;
+			shell->count[Sys_fcntl] += stages;
+		}
+
+		if (meter_option && j->foreground && relays > 0)
+		{
+			shell->count[Sys_timerfd_create]++;
+			shell->count[Sys_timerfd_settime]++;
+		}
+	}
+
+	if (w != NULL)
+	{
+		shell->count[Sys_timerfd_create]++;		// deadline
+		shell->count[Sys_timerfd_settime] += (w->timeout_ms != 0);
+		if (w->rss_limit || w->stall_ms)
+		{
+			shell->count[Sys_timerfd_create]++;	// sampling
+			shell->count[Sys_timerfd_settime]++;
+		}
+	}
+}
+
+static void print_source (const char* what, const char* redirect, const char* op, const char* other)
+{
+	if (redirect != NULL)
+		printf("       %-6s %s %s\n", what, op, redirect);
+	else if (other != NULL)
+		printf("       %-6s %s\n", what, other);
+	else
+		printf("       %-6s the shell's\n", what);
+}
+
+/* Returns -1 on a usage error */
+int explain_Job (char** tokens)
+{
+	if (no_tokens(tokens))
+		return -1;
+
+	int json;
+	int timed = get_time_prefix(tokens, &json);
+	tokens += timed;
+
+	Limits* l = NULL;
+	char** command = set_limit_start(tokens);
+	if (command != tokens)
+	{
+		if (no_tokens(command))
+			return -1;
+		if ((l = make_Limits(tokens+1)) == NULL)
+			return 0;
+		tokens = command;
+	}
+
+	Watchdog* w = NULL;
+	char** watch_options = set_watchdog_start(tokens);
+	if (watch_options != NULL && (w = make_Watchdog(watch_options)) == NULL)
+	{
+		free(l);
+		return 0;
+	}
+
+	if (no_tokens(tokens))
+	{
+		free(l);
+		free(w);
+		return -1;
+	}
+
+	dry_run = 1;
+	Job* j = make_Job(tokens);
+	dry_run = 0;
+	if (j == NULL)
+	{
+		free(l);
+		free(w);
+		return 0;
+	}
+	Job_count--; // explained, not kept: the number goes to the next real job
+	j->limits = l;
+	if (!j->foreground)
+		j->sched = bgsched_option;
+
+	int stages = 0, relays = 0;
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		stages++;
+		relays += (p->relay != NULL);
+	}
+	int supervised = supervisor_option && !j->foreground && stages > 1 && relays == 0;
+	int tracing = trace_option && trace.ring != NULL;
+
+
+	/* Job */
+	printf("%s job, %d stage%s%s%s\n", j->foreground ? "foreground" : "background", stages, stages > 1 ? "s" : "",
+		timed ? ", timed" : "", w != NULL ? ", watched" : "");
+	if (supervised)
+		printf("  fork: the shell forks stage 1 only, which leads the job and forks the rest (set -o supervisor)\n");
+	else
+		printf("  fork: the shell forks every stage; they are held at a barrier until all are in the group\n");
+	printf("  process group: a new one, led by stage 1\n");
+	if (j->foreground && (interactive || script_terminal))
+		printf("  terminal: handed to the job before it starts, back to the shell when it stops or ends\n");
+	else
+		printf("  terminal: stays with the shell\n");
+	if (j->sched != Normal_Sched)
+		printf("  scheduling: %s (set -o bgsched)\n", bgsched_choices[j->sched]);
+	if (placement_option && !(l != NULL && l->has_cpus) && !(j->foreground && stages == 1))
+		printf("  placement: pinned to the least loaded L3 domain, or L2 group in it if the stages fit (set -o placement)\n");
+
+
+	/* Stages */
+	Syscall_Plan shell, leader, children[stages];
+	memset(&shell, 0, sizeof(shell));
+	memset(&leader, 0, sizeof(leader));
+	memset(children, 0, sizeof(children));
+
+	int i = 0;
+	for (Process* p = j->p; p != NULL; p = p->next, i++)
+	{
+		char path[4096], from[64], to[64];
+		int tries;
+		if (p->argv[0] == NULL) // "ls | | wc", "> f": forked all the same, with nothing to exec
+		{
+			printf("  %d  (empty stage)\n", i + 1);
+			printf("       exec   nothing: the stage fails right after the fork\n");
+			tries = 0;
+		}
+		else
+		{
+			tries = resolve_Program(p->argv[0], path, sizeof(path));
+
+			char* text = concat_tokens(p->argv, " ");
+			printf("  %d  %s\n", i + 1, text);
+			free(text);
+			if (path[0] != 0)
+				printf("       exec   %s (execve %d time%s)\n", path, tries, tries > 1 ? "s" : "");
+			else
+				printf("       exec   not found: %d failed execve, then \"command not found\"\n", tries);
+		}
+
+		snprintf(from, sizeof(from), p->relay != NULL ? "relayed by the shell from stage %d (|>)" : "pipe from stage %d", i);
+		snprintf(to, sizeof(to), (p->next != NULL && p->next->relay != NULL) ? "pipe to the shell, relayed to stage %d (|>)" : "pipe to stage %d", i + 2);
+		print_source("stdin", p->redirect[0], "<", i > 0 ? from : NULL);
+		print_source("stdout", p->redirect[1], ">", p->next != NULL ? to : NULL);
+		print_source("stderr", p->redirect[2], "2>", NULL);
+
+		plan_Stage(j, p, i, stages, supervised, tracing, tries, &children[i]);
+	}
+	plan_Shell(j, stages, relays, supervised, tracing, w, &shell, &leader);
+
+
+	/* Syscalls */
+	int total = sum_Plan(&shell) + sum_Plan(&leader);
+	for (i=0; i < stages; i++)
+		total += sum_Plan(&children[i]);
+
+	printf("syscalls to launch: %d (predicted)\n", total);
+	print_Plan("shell", &shell);
+	if (supervised)
+		print_Plan("leader", &leader);
+	for (i=0; i < stages; i++)
+	{
+		char who[24];
+		snprintf(who, sizeof(who), "stage %d", i + 1);
+		print_Plan(who, &children[i]);
+	}
+
+	destroy_Job(j);
+	free(w);
+	return 0;
+}
+
+
+#endif /* EXPLAIN_H */
+
+
+
+/* Test EXPLAIN */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// setvbuf, printf
+#include <fcntl.h>			// open
+
+/* Explaining must not touch the redirect targets, nor use up a job number */
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+	interactive = 0;
+	unlink("/tmp/yash_explain_test");
+
+	strcpy(input_buffer, "cat < /etc/passwd | grep root |> wc -l > /tmp/yash_explain_test &");
+	if (explain_Job(set_tokens(" \t")) == -1)
+		return 1;
+
+	int fd = open("/tmp/yash_explain_test", O_RDONLY);
+	printf("target created: %s, next job: %d\n", fd == -1 ? "no" : "yes", Job_count);
+	return fd != -1 || Job_count != 1;
+}
+#endif
+/* Test EXPLAIN */
@@ -1,484 +1,942 @@
-#ifndef JOB_H
-#define JOB_H
-
-
-#include <unistd.h>			// fork, pid_t, execvp
-#include <fcntl.h>			// open
-#include <signal.h>			// SIGINT, SIGTSTP, signal, SIG_ERR
-#include <stdlib.h>			// malloc, free
-#include <stdio.h>			// fprintf, perror
-#include <errno.h>			// ENOENT
-#include <string.h>			// strdup
-#include <termios.h>		// struct termios, tcsetattr, tcgetattr
-#include "tokenize.h"
-#include "parse_tokens.h"
-#include <assert.h>			// assert
-#include "faces.h"
-
-#define MAX_PIPE_MEMBERS 100
-
-
-typedef enum
-{
-	Error_State = -1,
-	Running_State,
-	Stopped_State,
-	Done_State
-} State;
-
-const char* state_strings[] =
-{
-	"Error",
-	"Running",
-	"Stopped",
-	"Done",
-};
-
-const char* get_state_string (State state)
-{
-	return state_strings[state + 1];
-}
-
-typedef struct Process
-{
-	pid_t pid;
-	int in, out, err;
-	int close_me[3];
-	State state;
-	struct Process* next;
-} Process;
-
-
-typedef struct Job
-{
-	int index;
-	pid_t pgid;
-	int foreground;
-	char* command;
-	State state;
-	Process* p;
-	struct termios tmodes;
-	struct Job* next;
-} Job;
-
-
-static char** tmp_process_tokens[MAX_PIPE_MEMBERS] = {NULL};
-int Job_count = 1;
-Job* current_Job = NULL;
-struct termios shell_tmodes;
-pid_t shell_pid = -1;
-
-static void destroy_Process (Process* p)
-{
-	if (p == NULL)
-		return;
-
-	if (p->in != -1 && p->close_me[0])
-		close(p->in);
-
-	if (p->out != -1 && p->close_me[1])
-		close(p->out);
-
-	if (p->err != -1 && p->close_me[2])
-		close(p->err);
-
-	free(p);
-}
-
-
-static void destroy_Job (Job* j)
-{
-	if (j == NULL)
-		return;
-
-	if (j->p != NULL)
-	{
-		Process* p = j->p;
-		Process* next = p->next;
-		while (p != NULL)
-		{
-			destroy_Process(p);
-			p = next;
-			if (next != NULL)
-				next = next->next;
-		}
-	}
-
-	free(j->command);
-
-	free(j);
-}
-
-
-static int set_redirect (Process* p, char* path, int which)
-{
-	if (path == NULL)
-		return 0;
-
-	int success = -1;
-	if (which == 0)
-		success = p->in = open(path, O_RDONLY);
-	else if (which == 1)
-		success = p->out = creat(path, (S_IRUSR|S_IWUSR) | (S_IRGRP|S_IWGRP) | (S_IROTH|S_IWOTH));
-	else if (which == 2)
-		success = p->err = creat(path, (S_IRUSR|S_IWUSR) | (S_IRGRP|S_IWGRP) | (S_IROTH|S_IWOTH));
-
-	if (success == -1)
-	{
-		destroy_Process(p);
-		fprintf(stderr, "yash: ");
-		perror(path);
-		return -1;
-	}
-
-	p->close_me[which] = 1;
-
-	return 0;
-}
-
-
-static Process* make_Process (char** tokens)
-{
-	assert(tokens != NULL);
-
-
-	/* Allocate space for process */
-	Process* p = (Process*) malloc(sizeof(Process));
-	if (p == NULL)
-	{
-		perror(flip_table " yash: make_Process: malloc");
-		return NULL;
-	}
-
-
-	/* Default initialization */
-	p->in = -1;
-	p->out = -1;
-	p->err = -1;
-	for (int i=0; i<3; i++)
-		p->close_me[i] = 0;
-	p->state = Running_State;
-	p->next = NULL;
-
-
-	/* Get redirect paths */
-	char* path[3];
-	enum {in, out, err};
-	path[in] = get_redirect_in(tokens);
-	path[out] = get_redirect_out(tokens);
-	path[err] = get_redirect_error(tokens);
-
-
-	/* Get order of redirects inputted */
-	int index[3] = {0,1,2};
-	for (int i=0; i<2; i++)
-	{
-		int least = i;
-		for (int j=i+1; j<3; j++)
-			if (path[index[j]] < path[index[least]])
-				least = j;
-
-		if (least == index[i])
-			continue;
-
-		int tmp = index[i];
-		index[i] = index[least];
-		index[least] = tmp;
-	}
-
-
-	/* Parse redirects (in received order) */
-	for (int i=0; i<3; i++)
-		if (set_redirect(p, path[index[i]], index[i]) == -1)
-			return NULL;
-
-
-	return p;
-}
-
-
-Job* make_Job (char** tokens)
-{
-	assert(tokens != NULL);
-
-
-	/* Allocate space for Job */
-	Job* j = (Job*) malloc(sizeof(Job));
-	if (j == NULL)
-	{
-		perror(flip_table " yash: make_Job: malloc");
-		return NULL;
-	}
-
-
-	/* Default initialization */
-	j->index = Job_count++;
-	j->pgid = 0;
-	j->foreground = !clear_ampersand(tokens);
-	j->command = concat_tokens(tokens," ");
-	j->state = Running_State;
-	j->tmodes = shell_tmodes;
-	j->next = NULL;
-
-
-	/* Make processes */
-	int i = 0;
-	Process* last = NULL;
-	while (tokens != NULL && i < MAX_PIPE_MEMBERS)
-	{
-		char** next_tokens = set_pipe_start(tokens);
-
-		Process* p = NULL;
-		if (i == 0)
-			p = j->p = make_Process(tokens);
-		else
-			p = last->next = make_Process(tokens);
-
-		if (p == NULL)
-		{
-			destroy_Job(j);
-			return NULL;
-		}
-
-		/* Clip command args at first special symbol */
-		set_args_end(tokens);
-
-		last = p;
-		tmp_process_tokens[i] = tokens;
-		tokens = next_tokens;
-		i++;
-	}
-
-
-	return j;
-}
-
-
-/* Called in forked child. */
-static void launch_Process (Process* p, int pipe_in, int pipe_out, char** tokens)
-{
-	// printf("My pid: %d, pgid: %d\n", getpid(), getpgid(0));
-
-	/* Reset Signals */
-	if (signal (SIGINT, SIG_DFL) == SIG_ERR)  perror(flip_table " yash: signal");
-	if (signal (SIGQUIT, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
-	if (signal (SIGTSTP, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
-	if (signal (SIGTTIN, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
-	if (signal (SIGTTOU, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
-	if (signal (SIGCHLD, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
-
-
-	/* Init Pipes/Redirects */
-	if (p->in != -1)
-	{
-		if (dup2(p->in, STDIN_FILENO) == -1)
-			perror(flip_table " yash: redirecting stdin");
-		close(p->in);
-	}
-	else if (pipe_in != -1)
-	{
-		if (dup2(pipe_in, STDIN_FILENO) == -1)
-			perror(flip_table " yash: pipe in");
-		close(pipe_in);
-	}
-
-	if (p->out != -1)
-	{
-		if (dup2(p->out, STDOUT_FILENO) == -1)
-			perror(flip_table " yash: redirecting stdout");
-		close(p->out);
-	}
-	else if (pipe_out != -1)
-	{
-		if (dup2(pipe_out, STDOUT_FILENO) == -1)
-		{
-			fprintf(stderr, "(%d) ", pipe_out);
-			perror(flip_table " yash: pipe out");
-		}
-		close(pipe_out);
-	}
-
-	if (p->err != -1)
-	{
-		if (dup2(p->err, STDERR_FILENO) == -1)
-			perror(flip_table " yash: redirecting stderr");
-		close(p->err);
-	}
-
-
-	/* Execute Process */
-	execvp(tokens[0], tokens);
-
-	if (errno == ENOENT)
-		fprintf(stderr, "%s: command not found\n", tokens[0]);
-	else
-	{
-		fprintf(stderr, flip_table " yash: exec: ");
-		perror(tokens[0]);
-	}
-
-
-	_exit(1);
-}
-
-
-int launch_Job (Job* j)
-{
-	pid_t pid = 0, pgid = 0;
-
-	struct{
-		union{
-			int array[2];
-			struct{
-			int next_in,
-				out;
-			};
-		};
-		int in;
-	} Pipe = {{{-1, -1}}, -1};
-
-
-	int i = 0;
-	Process* p = j->p;
-	while (p != NULL)
-	{
-		/* Cleaning pipes */
-		if (i > 0)
-		{
-			close(Pipe.out); // close pipe-out of previous process
-			Pipe.in = Pipe.next_in; // save pipe-in to close after launching process
-		}
-
-		/* Pipe (if not last process) */
-		if (p->next != NULL)
-		{
-			if (pipe(Pipe.array) == -1)
-			{
-				perror(flip_table " yash: pipe");
-				return -1;
-			}
-		}
-		else
-			Pipe.out=-1;
-
-		pid = fork();
-		pgid = j->pgid;
-
-		/* Fork Error */
-		if (pid == -1)
-		{
-			perror(flip_table " yash: fork");
-			return -1;
-		}
-
-		/* Child */
-		else if (pid == 0)
-		{
-			/* Place Child Process in Job process group.
-			   Repeated x2 to avoid race condition.
-			   Controlling Terminal set at every child,
-			   also to avoid race condition. */
-			pid = getpid();
-			if (pgid == 0)
-				pgid = pid;
-			setpgid(pid, pgid);
-			if (j->foreground)
-				if (tcsetpgrp (STDIN_FILENO, pgid) == -1)
-					perror(blank_face " Warning: tcsetpgrp");
-
-			launch_Process(p, Pipe.in, Pipe.out, tmp_process_tokens[i]);
-		}
-
-		/* Parent */
-		else
-		{
-			/* Place Child Process in Job process group.
-			   Repeated x2 to avoid race condition.
-			   Controlling Terminal set at every child,
-			   also to avoid race condition. */
-			p->pid = pid;
-			if (pgid == 0)
-				j->pgid = pgid = pid;
-			setpgid(pid, pgid);
-			if (j->foreground)
-				if (tcsetpgrp (STDIN_FILENO, pgid) == -1)
-					perror(blank_face " Warning: tcsetpgrp");
-		}
-
-		if (i > 0)
-			close(Pipe.in); // close pipe-in of child
-
-		p = p->next;
-		i++;
-	}
-
-
-	return 0;
-}
-
-#endif /* JOB_H */
-
-
-
-/* Test JOB */
-#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
-#include <stdio.h>			// setvbuf, freopen, printf
-#include <fcntl.h>			// open
-#include <unistd.h>			// usleep, close
-#include "faces.h"
-
-
-int main(int argc, char* argv[])
-{
-	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
-
-	if (argc == 1)
-		freopen("input.txt", "r", stdin);
-
-	if (!isatty(STDIN_FILENO))
-		printf(blank_face " Warning: Job Control won't work because the program is not executing from a tty.\n");
-
-	for (int i=0; read_line(stdin) != NULL; i++) {
-		char** tokens = set_tokens(" \t");
-
-		print_tokens(tokens);
-		if (no_tokens(tokens))
-			continue;
-
-		current_Job = make_Job(tokens);
-		if (current_Job == NULL)
-			continue;
-
-		launch_Job(current_Job);
-		destroy_Job(current_Job);
-		current_Job = NULL;
-	}
-
-	/* Display for debug */
-	usleep(150000);
-	int o = open("out.txt",O_RDONLY);
-	int o2 = open("out2.txt",O_RDONLY);
-	int e = open("error.txt",O_RDONLY);
-
-	char c[64];
-	ssize_t bytes = 0;
-	printf("out.txt:\n");
-	while ((bytes = read(o, c, 64)))
-		write(STDOUT_FILENO, c, bytes);
-	printf("\n\n");
-
-	printf("out2.txt:\n");
-	while ((bytes = read(o2, c, 64)))
-		write(STDOUT_FILENO, c, bytes);
-	printf("\n\n");
-
-	printf("error.txt:\n");
-	while ((bytes = read(e, c, 64)))
-		write(STDOUT_FILENO, c, bytes);
-
-	close(o);
-	close(o2);
-	close(e);
-}
-#endif
+#ifndef JOB_H
+#define JOB_H
+
+#include <unistd.h>			// fork, pid_t, execvp, syscall, close_range
+#include <fcntl.h>			// open
+#include <signal.h>			// SIGINT, SIGTSTP, signal, SIG_ERR
+#include <stdlib.h>			// malloc, free
+#include <stdio.h>			// fprintf, perror
+#include <errno.h>			// ENOENT
+#include <string.h>			// strdup
+#include <termios.h>		// struct termios, tcsetattr, tcgetattr
+#include <sys/syscall.h>	// SYS_clone
+#include <sys/resource.h>	// struct rusage, getrusage
+#include "tokenize.h"
+#include "parse_tokens.h"
+#include "job_limits.h"
+#include "topology.h"
+#include "options.h"
+#include "events.h"
+#include "relay.h"
+#include "stats.h"
+#include <assert.h>			// assert
+#include "faces.h"
+
+#define MAX_PIPE_MEMBERS 1024
+
+#ifndef CLONE_PARENT
+#define CLONE_PARENT 0x00008000
+#endif
+
+
+typedef enum
+{
+	Error_State = -1,
+	Queued_State,
+	Running_State,
+	Stopped_State,
+	Done_State
+} State;
+
+const char* state_strings[] =
+{
+	"Error",
+	"Queued",
+	"Running",
+	"Stopped",
+	"Done",
+};
+
+const char* get_state_string (State state)
+{
+	return state_strings[state + 1];
+}
+
+typedef struct Process
+{
+	pid_t pid;
+	char** argv;			// owned copy: queued jobs launch after the input line is gone
+	int in, out, err;
+	int close_me[3];
+	int exec_fd;			// set -o trace: child's end of the exec notification pipe, or -1
+	int exec_slot;			// where the child stamps its exec time (stats.h), or -1
+	int status;				// from wait4, once Done
+	struct rusage usage;	// from wait4, once Done
+	long long start_ns;		// fork (CLOCK_MONOTONIC)
+	long long end_ns;		// reap, once Done
+	Relay* relay;			// "|>" into this stage: the shell relays its input, or NULL
+	char* redirect[3];		// explain: targets of <, > and 2> as typed (in the input line), or NULL
+	State state;
+	struct Process* next;
+} Process;
+
+
+typedef enum
+{
+	No_Time,
+	Human_Time,
+	Json_Time
+} Time_Format;
+
+typedef struct Job
+{
+	int index;
+	pid_t pgid;
+	int foreground;
+	char* command;
+	State state;
+	const char* reason;		// why the shell killed it (watchdog), or NULL
+	int queued;				// admitted through the job queue
+	Limits* limits;			// applied by each child before exec, or NULL
+	int domain;				// L3 domain it was placed on (set -o placement), or -1
+	int l2;					// L2 group inside it the job was pinned to, or -1
+	Sched_Class sched;		// class given to it while in the background (set -o bgsched)
+	int report_fd;			// supervised launch: leader's pid report still to read, or -1
+	int release_fd;			// supervised launch: closing it lets the leader's siblings exec
+	Time_Format timed;		// "time" prefix: report when it finishes
+	long long start_ns;		// launch_Job entered (CLOCK_MONOTONIC)
+	long long launch_ns;	// time spent in launch_Job
+	long long end_ns;		// last stage reaped
+	double shell_cpu;		// shell's own CPU seconds at launch; once ended, spent until then
+	Meter* meter;			// status line of its relayed pipes (set -o meter), or NULL
+	int line;				// script mode: the line it was read from, or 0
+	Process* p;
+	struct termios tmodes;
+	struct Job* next;
+} Job;
+
+
+int Job_count = 1;
+Job* current_Job = NULL;
+unsigned long long jobs_launched = 0, jobs_finished = 0;			// since the shell started
+unsigned long long processes_forked = 0, processes_reaped = 0;
+struct termios shell_tmodes;
+pid_t shell_pid = -1;
+int dry_run = 0;			// explain: make_Job notes redirect targets instead of opening them
+int interactive = 1;		// 0 while running a script: there is no terminal to hand over
+int script_terminal = 0;	// unless the script was started in the terminal's foreground
+
+
+/* User + system CPU seconds of the shell itself */
+double get_shell_cpu ()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/* The shell's copies of the redirect files: once the child is forked they only cost fds */
+static void close_Redirects (Process* p)
+{
+	int* fd[3] = {&p->in, &p->out, &p->err};
+
+	for (int i=0; i<3; i++)
+		if (*fd[i] != -1 && p->close_me[i])
+		{
+			close(*fd[i]);
+			*fd[i] = -1;
+			p->close_me[i] = 0;
+		}
+}
+
+static void destroy_Process (Process* p)
+{
+	if (p == NULL)
+		return;
+
+	close_Redirects(p);
+	destroy_Relay(p->relay);
+
+	free(p->argv);
+	free(p);
+}
+
+
+static void destroy_Job (Job* j)
+{
+	if (j == NULL)
+		return;
+
+	destroy_Meter(j->meter);
+
+	if (j->p != NULL)
+	{
+		Process* p = j->p;
+		Process* next = p->next;
+		while (p != NULL)
+		{
+			destroy_Process(p);
+			p = next;
+			if (next != NULL)
+				next = next->next;
+		}
+	}
+
+	if (j->report_fd != -1)
+	{
+		remove_Event(j->report_fd);
+		close(j->report_fd);
+		close(j->release_fd);
+	}
+
+	free(j->command);
+	free(j->limits);
+
+	free(j);
+}
+
+
+static inline void mark_Job (Job* j, State s)
+{
+	j->state = s;
+	for (Process* p = j->p; p != NULL; p = p->next)
+		p->state = s;
+}
+
+/* Some process has been launched and not yet reaped */
+static inline int is_Alive (Job* j)
+{
+	for (Process* p = j->p; p != NULL; p = p->next)
+		if (p->state == Running_State || p->state == Stopped_State)
+			return 1;
+
+	return 0;
+}
+
+
+static int set_redirect (Process* p, char* path, int which)
+{
+	if (path == NULL)
+		return 0;
+
+	p->redirect[which] = path;
+	if (dry_run)
+		return 0;
+
+	/* Close-on-exec: only the child it is dup2'd into keeps it */
+	int success = -1;
+	if (which == 0)
+		success = p->in = open(path, O_RDONLY|O_CLOEXEC);
+	else if (which == 1)
+		success = p->out = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, (S_IRUSR|S_IWUSR) | (S_IRGRP|S_IWGRP) | (S_IROTH|S_IWOTH));
+	else if (which == 2)
+		success = p->err = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, (S_IRUSR|S_IWUSR) | (S_IRGRP|S_IWGRP) | (S_IROTH|S_IWOTH));
+
+	if (success == -1)
+	{
+		destroy_Process(p);
+		fprintf(stderr, "yash: ");
+		perror(path);
+		return -1;
+	}
+
+	p->close_me[which] = 1;
+
+	return 0;
+}
+
+
+static Process* make_Process (char** tokens)
+{
+	assert(tokens != NULL);
+
+
+	/* Allocate space for process */
+	Process* p = (Process*) malloc(sizeof(Process));
+	if (p == NULL)
+	{
+		perror(flip_table " yash: make_Process: malloc");
+		return NULL;
+	}
+
+
+	/* Default initialization */
+	p->in = -1;
+	p->out = -1;
+	p->err = -1;
+	for (int i=0; i<3; i++)
+		p->close_me[i] = 0;
+	p->pid = 0;
+	p->argv = NULL;
+	p->status = 0;
+	memset(&p->usage, 0, sizeof(p->usage));
+	p->start_ns = p->end_ns = 0;
+	p->relay = NULL;
+	p->redirect[0] = p->redirect[1] = p->redirect[2] = NULL;
+	p->exec_fd = -1;
+	p->exec_slot = -1;
+	p->state = Running_State;
+	p->next = NULL;
+
+
+	/* Get redirect paths */
+	char* path[3];
+	enum {in, out, err};
+	path[in] = get_redirect_in(tokens);
+	path[out] = get_redirect_out(tokens);
+	path[err] = get_redirect_error(tokens);
+
+
+	/* Get order of redirects inputted */
+	int index[3] = {0,1,2};
+	for (int i=0; i<2; i++)
+	{
+		int least = i;
+		for (int j=i+1; j<3; j++)
+			if (path[index[j]] < path[index[least]])
+				least = j;
+
+		if (least == index[i])
+			continue;
+
+		int tmp = index[i];
+		index[i] = index[least];
+		index[least] = tmp;
+	}
+
+
+	/* Parse redirects (in received order) */
+	for (int i=0; i<3; i++)
+		if (set_redirect(p, path[index[i]], index[i]) == -1)
+			return NULL;
+
+
+	return p;
+}
+
+
+Job* make_Job (char** tokens)
+{
+	assert(tokens != NULL);
+
+
+	/* Allocate space for Job */
+	Job* j = (Job*) malloc(sizeof(Job));
+	if (j == NULL)
+	{
+		perror(flip_table " yash: make_Job: malloc");
+		return NULL;
+	}
+
+
+	/* Default initialization */
+	j->index = Job_count++;
+	j->pgid = 0;
+	j->foreground = !clear_ampersand(tokens);
+	j->command = concat_tokens(tokens," ");
+	j->state = Running_State;
+	j->reason = NULL;
+	j->queued = 0;
+	j->limits = NULL;
+	j->domain = -1;
+	j->l2 = -1;
+	j->sched = Normal_Sched;
+	j->report_fd = -1;
+	j->release_fd = -1;
+	j->timed = No_Time;
+	j->start_ns = j->launch_ns = j->end_ns = 0;
+	j->shell_cpu = 0;
+	j->meter = NULL;
+	j->line = 0;
+	j->tmodes = shell_tmodes;
+	j->next = NULL;
+
+
+	/* Make processes */
+	int i = 0, relayed = 0;
+	Process* last = NULL;
+	while (tokens != NULL && i < MAX_PIPE_MEMBERS)
+	{
+		int relay_next = is_relayed_pipe(tokens);
+		char** next_tokens = set_pipe_start(tokens);
+
+		Process* p = NULL;
+		if (i == 0)
+			p = j->p = make_Process(tokens);
+		else
+			p = last->next = make_Process(tokens);
+
+		if (p == NULL || (relayed && (p->relay = make_Relay()) == NULL))
+		{
+			destroy_Job(j);
+			return NULL;
+		}
+
+		/* Clip command args at first special symbol */
+		set_args_end(tokens);
+
+		p->argv = copy_tokens(tokens);
+		if (p->argv == NULL)
+		{
+			perror(flip_table " yash: make_Job: copy_tokens");
+			destroy_Job(j);
+			return NULL;
+		}
+
+		last = p;
+		relayed = relay_next;
+		tokens = next_tokens;
+		i++;
+	}
+
+
+	return j;
+}
+
+
+/* Called in forked child. */
+static void launch_Process (Process* p, int pipe_in, int pipe_out, char** tokens, const Limits* limits)
+{
+	// printf("My pid: %d, pgid: %d\n", getpid(), getpgid(0));
+
+	/* Reset Signals */
+	if (signal (SIGINT, SIG_DFL) == SIG_ERR)  perror(flip_table " yash: signal");
+	if (signal (SIGQUIT, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
+	if (signal (SIGTSTP, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
+	if (signal (SIGTTIN, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
+	if (signal (SIGTTOU, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
+	if (signal (SIGCHLD, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal");
+	if (signal (SIGPIPE, SIG_DFL) == SIG_ERR) perror(flip_table " yash: signal"); // ignored by the shell for its relays
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL); // the shell blocks SIGCHLD for its signalfd
+
+
+	/* Init Pipes/Redirects */
+	if (p->in != -1)
+	{
+		if (dup2(p->in, STDIN_FILENO) == -1)
+			perror(flip_table " yash: redirecting stdin");
+		close(p->in);
+	}
+	else if (pipe_in != -1)
+	{
+		if (dup2(pipe_in, STDIN_FILENO) == -1)
+			perror(flip_table " yash: pipe in");
+		close(pipe_in);
+	}
+
+	if (p->out != -1)
+	{
+		if (dup2(p->out, STDOUT_FILENO) == -1)
+			perror(flip_table " yash: redirecting stdout");
+		close(p->out);
+	}
+	else if (pipe_out != -1)
+	{
+		if (dup2(pipe_out, STDOUT_FILENO) == -1)
+		{
+			fprintf(stderr, "(%d) ", pipe_out);
+			perror(flip_table " yash: pipe out");
+		}
+		close(pipe_out);
+	}
+
+	if (p->err != -1)
+	{
+		if (dup2(p->err, STDERR_FILENO) == -1)
+			perror(flip_table " yash: redirecting stderr");
+		close(p->err);
+	}
+
+
+	/* Nothing but 0-2 survives exec, whatever the shell inherited or leaked.
+	   (Everything the shell opens is close-on-exec already: this also covers fds
+	   yash itself was started with.) */
+#ifdef SYS_close_range
+	if (p->exec_fd != -1)
+	{
+		syscall(SYS_close_range, 3, p->exec_fd - 1, 0);
+		syscall(SYS_close_range, p->exec_fd + 1, ~0U, 0);
+	}
+	else
+		syscall(SYS_close_range, 3, ~0U, 0);
+#endif
+
+
+	/* Resource controls ("limit ... --") */
+	if (apply_Limits(limits) == -1)
+		_exit(1);
+
+
+	/* Execute Process */
+	stamp_Exec_Slot(p->exec_slot, 1);
+	notify_Exec(p->exec_fd);
+	execvp(tokens[0], tokens);
+	stamp_Exec_Slot(p->exec_slot, 0);
+	notify_Exec(p->exec_fd);
+
+	if (errno == ENOENT)
+		fprintf(stderr, "%s: command not found\n", tokens[0]);
+	else
+	{
+		fprintf(stderr, flip_table " yash: exec: ");
+		perror(tokens[0]);
+	}
+
+
+	_exit(1);
+}
+
+
+/* set -o placement: pin pipelines inside one L3 domain (inside one L2 group if they fit),
+   so adjacent stages share a cache, and spread background jobs over the least loaded domains.
+   Foreground single commands and jobs with an explicit "limit cpu=" are left alone. */
+static void place_Job (Job* j)
+{
+	int stages = 0;
+	for (Process* p = j->p; p != NULL; p = p->next)
+		stages++;
+
+	if ((j->foreground && stages == 1) || (j->limits != NULL && j->limits->has_cpus))
+		return;
+
+	int n_domains = load_Topology();
+	if (n_domains == 0)
+		return;
+
+
+	/* Least loaded domain: live processes already placed there, per cpu (and per L2 group) */
+	int load[MAX_DOMAINS] = {0}, l2_load[MAX_DOMAINS] = {0};
+	for (Job* other = current_Job; other != NULL; other = other->next)
+		if (other != j && other->domain != -1)
+			for (Process* p = other->p; p != NULL; p = p->next)
+				if (p->state == Running_State || p->state == Stopped_State)
+				{
+					load[other->domain]++;
+					if (other->l2 != -1)
+						l2_load[other->l2]++;
+				}
+
+	int domain = 0;
+	for (int d=1; d < n_domains; d++)
+		if (load[d] * topology.l3[domain].n_cpus < load[domain] * topology.l3[d].n_cpus)
+			domain = d;
+
+
+	if (j->limits == NULL && (j->limits = (Limits*) calloc(1, sizeof(Limits))) == NULL)
+		return;
+
+	int l2 = (stages > 1) ? find_L2_Group(domain, stages, l2_load) : -1;
+	memcpy(j->limits->cpus, (l2 != -1) ? topology.l2[l2].cpus : topology.l3[domain].cpus, sizeof(j->limits->cpus));
+	j->limits->has_cpus = 1;
+	j->domain = domain;
+	j->l2 = l2;
+}
+
+
+/* Pids of the leader's siblings, in stage order (0 for a stage it couldn't fork) */
+static void on_Leader_report (int fd, short revents, void* data)
+{
+	Job* j = (Job*) data;
+	pid_t pids[MAX_PIPE_MEMBERS];
+	size_t expected = 0, got = 0;
+
+	for (Process* p = j->p->next; p != NULL; p = p->next)
+		expected += sizeof(pid_t);
+
+	/* Written at once by the leader: the rest is on its way if this read comes up short */
+	ssize_t bytes;
+	while (got < expected && (bytes = read(fd, (char*) pids + got, expected - got)) != 0)
+		if (bytes > 0)
+			got += bytes;
+		else if (errno != EINTR)
+			break;
+
+	int i = 0;
+	for (Process* p = j->p->next; p != NULL; p = p->next, i++)
+	{
+		p->pid = ((i+1) * sizeof(pid_t) <= got) ? pids[i] : 0;
+		if (p->pid <= 0)
+		{
+			p->pid = 0;
+			p->state = Error_State;
+		}
+		else
+			processes_forked++; // by the leader, for the shell
+	}
+
+	/* The shell can match every sibling to its stage now: let them run */
+	remove_Event(fd);
+	close(fd);
+	close(j->release_fd);
+	j->report_fd = j->release_fd = -1;
+}
+
+/* set -o supervisor: for a background pipeline the shell forks only the first stage,
+   which leads the job. The leader creates the pipes and forks the other stages with
+   CLONE_PARENT (so they are still the shell's children, in the leader's pgid), reports
+   their pids back over a pipe, and execs its own stage. The siblings hold off exec until
+   the shell has read the pids, so no exit status can arrive for a pid it doesn't know.
+   Shell-side cost is one fork per job, however wide the pipeline. */
+static int launch_Supervised_Job (Job* j)
+{
+	int report[2], release[2];
+	if (pipe2(report, O_CLOEXEC) == -1)
+	{
+		perror(flip_table " yash: pipe");
+		return -1;
+	}
+	if (pipe2(release, O_CLOEXEC) == -1)
+	{
+		perror(flip_table " yash: pipe");
+		close(report[0]);
+		close(report[1]);
+		return -1;
+	}
+
+	for (Process* p = j->p; p != NULL; p = p->next)
+		p->exec_slot = claim_Exec_Slot();
+
+	pid_t pid = fork();
+
+	/* Fork Error */
+	if (pid == -1)
+	{
+		perror(flip_table " yash: fork");
+		close(report[0]);
+		close(report[1]);
+		close(release[0]);
+		close(release[1]);
+		return -1;
+	}
+
+	/* Leader */
+	else if (pid == 0)
+	{
+		setpgid(0, 0);
+		close(report[0]);
+		close(release[1]);
+		if (j->sched != Normal_Sched && set_Sched_Class(0, j->sched) == -1)
+			perror(blank_face " yash: bgsched");
+
+		pid_t pids[MAX_PIPE_MEMBERS];
+		int n = 0;
+		int fds[2];
+		if (pipe2(fds, O_CLOEXEC) == -1)
+		{
+			perror(flip_table " yash: pipe");
+			_exit(1);
+		}
+		int leader_out = fds[1], in = fds[0];
+
+		for (Process* p = j->p->next; p != NULL; p = p->next)
+		{
+			int next[2] = {-1, -1};
+			if (p->next != NULL && pipe2(next, O_CLOEXEC) == -1)
+				perror(flip_table " yash: pipe");
+
+			pid_t child = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+			if (child == 0)
+			{
+				char c;
+				close(report[1]); // a dying leader must not leave the shell waiting
+				while (read(release[0], &c, 1) == -1 && errno == EINTR)
+					;
+				launch_Process(p, in, next[1], p->argv, j->limits);
+			}
+			if (child == -1)
+				perror(flip_table " yash: clone");
+
+			pids[n++] = (child > 0) ? child : 0;
+			close(in);
+			if (next[1] != -1)
+				close(next[1]);
+			in = next[0];
+		}
+
+		write(report[1], pids, n * sizeof(pid_t));
+		close(report[1]);
+
+		launch_Process(j->p, -1, leader_out, j->p->argv, j->limits);
+	}
+
+	/* Shell */
+	close(report[1]);
+	close(release[0]);
+	for (Process* p = j->p; p != NULL; p = p->next)
+		close_Redirects(p);
+
+	j->p->pid = j->pgid = pid;
+	processes_forked++;
+	setpgid(pid, pid); // before any kill(-pgid) from the shell
+	trace_Event(Trace_Fork, 0, pid, pid);
+	trace_Event(Trace_Setpgid, 0, pid, pid);
+	for (Process* p = j->p; p != NULL; p = p->next)
+		p->start_ns = get_monotonic_ns();
+
+	j->report_fd = report[0];
+	j->release_fd = release[1];
+	add_Event(j->report_fd, POLLIN, on_Leader_report, j);
+
+	j->launch_ns = get_monotonic_ns() - j->start_ns;
+	trace_Span(Trace_Launch, j->start_ns, j->pgid, 0, j->command);
+	return 0;
+}
+
+
+int launch_Job (Job* j)
+{
+	pid_t pid = 0, pgid = 0;
+
+	struct{
+		union{
+			int array[2];
+			struct{
+			int next_in,
+				out;
+			};
+		};
+		int in;
+	} Pipe = {{{-1, -1}}, -1};
+
+
+	j->start_ns = get_monotonic_ns();
+	j->shell_cpu = get_shell_cpu();
+	jobs_launched++;
+
+	if (placement_option)
+		place_Job(j);
+	if (!j->foreground)
+		j->sched = bgsched_option;
+	int relays = 0;
+	for (Process* p = j->p; p != NULL; p = p->next)
+		relays += (p->relay != NULL);
+
+	/* The leader creates the pipes: it can't hand the shell a relay's ends */
+	if (supervisor_option && !j->foreground && j->p->next != NULL && relays == 0)
+		return launch_Supervised_Job(j);
+
+
+	/* Start barrier: children wait for EOF on it before exec. It is released once the
+	   whole pipeline is forked and in its process group (and owns the terminal), so
+	   setpgid is done by the shell alone and tcsetpgrp only once per job. */
+	int barrier[2];
+	if (pipe2(barrier, O_CLOEXEC) == -1)
+	{
+		perror(flip_table " yash: pipe");
+		return -1;
+	}
+
+
+	int i = 0;
+	Process* p = j->p;
+	while (p != NULL)
+	{
+		/* Cleaning pipes */
+		if (i > 0)
+		{
+			close(Pipe.out); // close pipe-out of previous process
+			Pipe.in = Pipe.next_in; // save pipe-in to close after launching process
+		}
+
+		/* Pipe (if not last process) */
+		if (p->next != NULL)
+		{
+			if (pipe2(Pipe.array, O_CLOEXEC) == -1)
+			{
+				perror(flip_table " yash: pipe");
+				close(barrier[0]);
+				close(barrier[1]); // let what was forked run
+				return -1;
+			}
+
+			/* "|>": the next stage reads from the relay's pipe instead */
+			if (p->next->relay != NULL)
+			{
+				int relay_in = start_Relay(p->next->relay, Pipe.next_in);
+				if (relay_in == -1)
+				{
+					close(Pipe.next_in);
+					close(Pipe.out);
+					close(barrier[0]);
+					close(barrier[1]);
+					return -1;
+				}
+				Pipe.next_in = relay_in;
+			}
+		}
+		else
+			Pipe.out=-1;
+
+		int notify[2];
+		open_Exec_Notify(notify);
+		p->exec_slot = claim_Exec_Slot();
+
+		/* ^C and ^Z are the job's as soon as it has the terminal, which is before the
+		   barrier: the child drops the shell's handlers first, and they are blocked
+		   across the fork so none is caught in between */
+		sigset_t job_signals, saved_mask;
+		sigemptyset(&job_signals);
+		sigaddset(&job_signals, SIGINT);
+		sigaddset(&job_signals, SIGTSTP);
+		sigprocmask(SIG_BLOCK, &job_signals, &saved_mask);
+
+		pid = fork();
+		pgid = j->pgid;
+		if (pid != 0)
+			sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+
+		/* Fork Error */
+		if (pid == -1)
+		{
+			perror(flip_table " yash: fork");
+			close(barrier[0]);
+			close(barrier[1]);
+			if (notify[0] != -1)
+			{
+				close(notify[0]);
+				close(notify[1]);
+			}
+			return -1;
+		}
+
+		/* Child */
+		else if (pid == 0)
+		{
+			char c;
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTSTP, SIG_DFL);
+			sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+			close(barrier[1]);
+			while (read(barrier[0], &c, 1) == -1 && errno == EINTR)
+				;
+
+			if (j->sched != Normal_Sched && set_Sched_Class(0, j->sched) == -1)
+				perror(blank_face " yash: bgsched");
+
+			p->exec_fd = notify[1];
+			launch_Process(p, Pipe.in, Pipe.out, p->argv, j->limits);
+		}
+
+		/* Parent */
+		else
+		{
+			/* The child is held at the barrier, so it can't have exec'd yet */
+			p->pid = pid;
+			p->start_ns = get_monotonic_ns();
+			processes_forked++;
+			if (pgid == 0)
+				j->pgid = pgid = pid;
+			trace_Event(Trace_Fork, p->start_ns, pgid, pid);
+			if (setpgid(pid, pgid) == -1)
+				perror(blank_face " yash: setpgid");
+			trace_Event(Trace_Setpgid, 0, pgid, pid);
+			watch_Exec(notify, pgid, pid);
+			close_Redirects(p);
+		}
+
+		if (i > 0)
+			close(Pipe.in); // close pipe-in of child
+
+		p = p->next;
+		i++;
+	}
+
+
+	/* Hand over the terminal, then start every stage at once */
+	if (j->foreground && (interactive || script_terminal))
+	{
+		if (tcsetpgrp (STDIN_FILENO, j->pgid) == -1)
+			perror(blank_face " Warning: tcsetpgrp");
+		trace_Event(Trace_Tcsetpgrp, 0, j->pgid, 0);
+	}
+
+	close(barrier[0]);
+	close(barrier[1]);
+
+
+	if (meter_option && j->foreground && relays > 0)
+	{
+		Relay* list[MAX_PIPE_MEMBERS];
+		int n = 0;
+		for (p = j->p; p != NULL; p = p->next)
+			if (p->relay != NULL)
+				list[n++] = p->relay;
+		j->meter = start_Meter(j->index, j->pgid, list, n);
+	}
+
+
+	j->launch_ns = get_monotonic_ns() - j->start_ns;
+	trace_Span(Trace_Launch, j->start_ns, j->pgid, 0, j->command);
+	return 0;
+}
+
+/* After launch_Job failed part way (pipe, fork): the stages it forked are killed, the
+   others marked as never started, so the job ends (with an error) once they are reaped */
+void abort_Launch (Job* j)
+{
+	if (j->pgid > 0)
+		kill(- j->pgid, SIGKILL);
+	for (Process* p = j->p; p != NULL; p = p->next)
+		if (p->pid == 0)
+			p->state = Error_State;
+}
+
+#endif /* JOB_H */
+
+
+
+/* Test JOB */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// setvbuf, freopen, printf
+#include <fcntl.h>			// open
+#include <unistd.h>			// usleep, close
+#include "faces.h"
+
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	if (argc == 1)
+		freopen("input.txt", "r", stdin);
+
+	if (!isatty(STDIN_FILENO))
+		printf(blank_face " Warning: Job Control won't work because the program is not executing from a tty.\n");
+
+	for (int i=0; read_line(stdin) != NULL; i++) {
+		char** tokens = set_tokens(" \t");
+
+		print_tokens(tokens);
+		if (no_tokens(tokens))
+			continue;
+
+		current_Job = make_Job(tokens);
+		if (current_Job == NULL)
+			continue;
+
+		launch_Job(current_Job);
+		destroy_Job(current_Job);
+		current_Job = NULL;
+	}
+
+	/* Display for debug */
+	usleep(150000);
+	int o = open("out.txt",O_RDONLY);
+	int o2 = open("out2.txt",O_RDONLY);
+	int e = open("error.txt",O_RDONLY);
+
+	char c[64];
+	ssize_t bytes = 0;
+	printf("out.txt:\n");
+	while ((bytes = read(o, c, 64)))
+		write(STDOUT_FILENO, c, bytes);
+	printf("\n\n");
+
+	printf("out2.txt:\n");
+	while ((bytes = read(o2, c, 64)))
+		write(STDOUT_FILENO, c, bytes);
+	printf("\n\n");
+
+	printf("error.txt:\n");
+	while ((bytes = read(e, c, 64)))
+		write(STDOUT_FILENO, c, bytes);
+
+	close(o);
+	close(o2);
+	close(e);
+}
+#endif
 /* Test JOB */
\ No newline at end of file
@@ -1,510 +1,1318 @@
-#ifndef JOB_CONTROL_H
-#define JOB_CONTROL_H
-
-
-#include <unistd.h>			// fork, pid_t, execvp
-#include <signal.h>			// SIGINT, SIGTSTP, signal, SIG_ERR
-#include <sys/wait.h>		// wait
-#include <stdio.h>			// fprintf, perror
-#include <errno.h>			// ECHILD
-#include <string.h>			// strcpy
-#include <termios.h>		// tcsetattr, tcgetattr
-#include "job.h"
-#include <assert.h>			// assert
-#include "faces.h"
-
-
-static int is_State (Job* j, State s)
-{
-	if (s == Error_State)
-	{
-		for (Process* p= j->p; p != NULL; p = p->next)
-			if (p->state == s)
-				return 1;
-		return 0;
-	}
-	else if (s == Running_State)
-	{
-		for (Process* p= j->p; p != NULL; p = p->next)
-			if (p->state != s)
-				return 0;
-		return 1;
-	}
-	else
-	{
-		for (Process* p= j->p; p != NULL; p = p->next)
-			if (p->state < s)
-			{
-				// fprintf(stderr, "Job (%s) not %s: %s\n", j->command, get_state_string(s), get_state_string(p->state));
-				return 0;
-			}
-		// fprintf(stderr, "Job (%s) is %s\n", j->command, get_state_string(s));
-		return 1;
-	}
-}
-
-int is_Error (Job* j)
-{
-	return is_State(j, Error_State);
-}
-
-int is_Running (Job* j)
-{
-	return is_State(j, Running_State);
-}
-
-int is_Stopped (Job* j)
-{
-	return is_State(j, Stopped_State);
-}
-
-int is_Done (Job* j)
-{
-	return is_State(j, Done_State);
-}
-
-Process* find_Process (pid_t pid)
-{
-	for (Job* j = current_Job; j != NULL; j = j->next)
-		for (Process* p = j->p; p != NULL; p = p->next)
-			if (p->pid == pid)
-				return p;
-
-	return NULL;
-}
-
-Job* find_Job (pid_t pid)
-{
-	for (Job* j = current_Job; j != NULL; j = j->next)
-		for (Process* p = j->p; p != NULL; p = p->next)
-			if (p->pid == pid)
-				return j;
-
-	return NULL;
-}
-
-int count_Jobs (Job* j)
-{
-	int result = 0;
-	for (; j != NULL; j = j->next)
-		result++;
-
-	return result;
-}
-
-static void update_Process (Process* p, int status)
-{
-	assert (p != NULL);
-
-	if (WIFSTOPPED(status))
-	{
-		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Stopped_State));
-		p->state = Stopped_State;
-	}
-	else if (WIFEXITED(status))
-	{
-		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Done_State));
-		p->state = Done_State;
-	}
-	else if (WIFSIGNALED(status))
-	{
-		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Done_State));
-		if (WTERMSIG(status) != 2) // hack: Signal 2 is Ctrl+C
-		{
-			Job* parent = find_Job(p->pid);
-			parent->foreground = 0;	// exited while stopped from a signal,
-									// means probably a "kill <pid>" was sent in the shell.
-									// (in any case: want to print)
-		}
-		p->state = Done_State;
-	}
-	else
-	{
-		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Error_State));
-		p->state = Error_State;
-	}
-}
-
-static void mark_Job (Job* j, State s)
-{
-	j->state = s;
-	for (Process* p = j->p; p != NULL; p = p->next)
-		p->state = s;
-}
-
-static void get_Job_status (Job* j, int WAIT)
-{
-	if (j == NULL)
-		return;
-
-	pid_t pid;
-	int status;
-	int options = (WAIT) ? WUNTRACED : WUNTRACED|WNOHANG;
-
-	while (!is_Stopped(j))
-	{
-		pid = waitpid(WAIT_ANY, &status, options);
-
-		if (!WAIT && pid == 0)
-			return; // Still Running
-
-		if (WAIT && pid == -1 && errno == ECHILD)
-		{
-			mark_Job(j, Done_State); // hack: Mark Job as Done... Somehow it skipped being a zombie
-			break;
-		}
-
-		if (pid == -1)
-		{
-			perror(blank_face " yash: waitpid");
-			return;
-		}
-
-		Process* p = find_Process(pid);
-		update_Process(p, status);
-		if (p->state == Error_State)
-		{
-			j->state = Error_State;
-			return;
-		}
-	}
-
-	if (is_Done(j))
-		j->state = Done_State;
-	else
-	{
-		if (WAIT && j->foreground)
-			tcgetattr(STDIN_FILENO, &j->tmodes); // save Job's terminal modes
-		j->state = Stopped_State;
-	}
-}
-
-void update_Job (Job* j)
-{
-	// fprintf(stderr, "Entering %s\n", __PRETTY_FUNCTION__);
-	get_Job_status(j, 0);
-}
-
-void wait_Job (Job* j)
-{
-	// fprintf(stderr, "Entering %s\n", __PRETTY_FUNCTION__);
-	get_Job_status(j, 1);
-}
-
-void update_Jobs ()
-{
-	for (Job* j = current_Job; j != NULL; j = j->next)
-		update_Job(j);
-}
-
-#define JOB_STRING_SIZE 1+32+1+1+2+24+2+2+1
-static char* get_Job_string (Job* j)
-{
-	static char buffer[JOB_STRING_SIZE+1];
-
-	sprintf(buffer,
-			"[%d]%c  %-24s%%s %c\n",
-			j->index,
-			(j == current_Job) ? '+' : '-',
-			get_state_string(j->state),
-			// fill in [ j->command ] using printf
-			j->foreground ? ' ' : '&'
-			);
-
-	return buffer;
-}
-
-void print_Job (Job* j)
-{
-	printf(get_Job_string(j), j->command);
-}
-
-/* Delete Done/Error jobs */
-void clean_Jobs(int UPDATE_FIRST)
-{
-	if (UPDATE_FIRST)
-		update_Jobs();
-
-	Job* last = NULL;
-	Job* j = current_Job;
-	while (j != NULL)
-	{
-		switch (j->state)
-		{
-			case Running_State:
-			case Stopped_State:
-				last = j;
-				j = j->next;
-				break;
-			case Error_State:
-			case Done_State:
-				if (last != NULL)
-				{
-					last->next = j->next;
-					destroy_Job(j);
-					j = last;
-					Job_count--;
-				}
-				else
-				{
-					current_Job = j->next;
-					destroy_Job(j);
-					j = current_Job;
-					Job_count--;
-				}
-		}
-	}
-}
-
-void print_Jobs (int LIST_ALL)
-{
-	update_Jobs();
-
-
-	char messages[Job_count][JOB_STRING_SIZE+1];
-	char* commands[Job_count];
-	int index = 0;
-
-
-	for (Job* j = current_Job; j != NULL; j = j->next)
-	{
-		switch (j->state)
-		{
-			case Running_State:
-			case Stopped_State:
-				if (LIST_ALL)
-				{
-					strcpy(messages[index], get_Job_string(j));
-					commands[index++] = j->command;
-				}
-				break;
-			case Error_State:
-			case Done_State:
-				if (LIST_ALL || !j->foreground)
-				{
-					strcpy(messages[index], get_Job_string(j));
-					commands[index++] = j->command;
-				}
-		}
-	}
-
-
-	/* Print in reverse order (oldest to newest) */
-	for (int i=index-1; 0<=i; --i)
-		printf(messages[i], commands[i]);
-
-
-	clean_Jobs(0);
-}
-
-static void fg ()
-{
-	Job* j;
-
-	for (j = current_Job; j != NULL; j = j->next)
-	{
-		if (j->state == Running_State)
-			if (!j->foreground)
-				break;
-		if (j->state == Stopped_State)
-			break;
-	}
-
-	if (j == NULL)
-	{
-		fprintf(stderr, "yash: fg: current: no such job\n");
-		return;
-	}
-
-
-	int save_Stopped_State = j->state == Stopped_State;
-	j->foreground = 1;
-	mark_Job(j, Running_State);
-	print_Job(j);
-
-
-	if (save_Stopped_State)
-		tcsetattr(STDIN_FILENO, TCSADRAIN, &j->tmodes); // restore Jobs terminal modes
-	tcsetpgrp(STDIN_FILENO, j->pgid);
-
-
-	kill(- j->pgid, SIGCONT);
-	wait_Job(j);
-}
-
-static void bg ()
-{
-	Job* j;
-
-	for (j = current_Job; j != NULL; j = j->next)
-		if (j->state == Stopped_State)
-			break;
-
-	if (j == NULL)
-	{
-		fprintf(stderr, "yash: bg: current: no such job\n");
-		return;
-	}
-
-	j->foreground = 0;
-	mark_Job(j, Running_State);
-
-	print_Job(j);
-	kill(- j->pgid, SIGCONT);
-}
-
-int launch_builtin (char** tokens)
-{
-	static const char* special[] = {"fg", "bg", "jobs", "exit"};
-
-	if (!no_tokens(tokens+1))
-		return 0;
-
-	if(strcmp(tokens[0], special[0]) == 0)
-		fg();
-	else if(strcmp(tokens[0], special[1]) == 0)
-		bg();
-	else if(strcmp(tokens[0], special[2]) == 0)
-		print_Jobs(1);
-	else if(strcmp(tokens[0], special[3]) == 0)
-		exit(0);
-	else
-		return 0;
-
-	return 1;
-}
-
-
-#endif /* JOB_CONTROL_H */
-
-
-
-/* Test JOB_CONTROL */
-#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
-#include <signal.h>			// kill, signal
-#include <stdio.h>			// printf, fflush, setvbuf, perror
-#include <unistd.h>			// isatty, setpgid, tcgetpgrp, tcsetpgrp, getpgid, getpid
-#include <stdlib.h>			// exit, atexit
-#include "tokenize.h"
-#include "job.h"
-#include "job_control.h"
-#include "faces.h"
-#include <string.h>			// strcmp
-
-
-void exit_handler ()
-{
-	for (Job* j = current_Job; j != NULL; j = j->next)
-		kill (- j->pgid, SIGHUP);
-	destroy_Job(current_Job);
-	printf("exit\n");
-}
-
-
-void signal_handler (int signo)
-{
-	switch(signo)
-	{
-		case SIGINT:
-		case SIGTSTP:
-			printf("\n# ");
-			fflush(stdout);
-	}
-}
-
-
-int prompt ()
-{
-	print_Jobs(0);
-	tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes); // restore shell terminal modes
-	tcsetpgrp(STDIN_FILENO, shell_pid);
-
-	printf("# ");
-	return read_line(stdin) != NULL;
-}
-
-
-int main(int argc, char* argv[])
-{
-	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
-
-
-	if (argc == 2 && strcmp(argv[1], "pikachu") == 0)
-		fprintf(stderr,
-			"\n"
-			"         YASH!"
-			pikachu "\n"
-			"(...and his best friend ^)\n\n"
-		);
-
-
-	if (!isatty(STDIN_FILENO))
-	{
-		fprintf(stderr, flip_table " yash: abort reason: Job control won't work because yash is not executing from a tty\n");
-		return 0;
-	}
-
-
-	shell_pid = getpid();
-	if (setpgid(0,0) == -1)
-	{
-		perror (flip_table " yash: abort reason: Couldn't put yash in its own process group");
-		return 0;
-	}
-	// printf("My pid: %d, pgid: %d\n", getpid(), getpgid(0));
-
-
-	while (tcgetpgrp (STDIN_FILENO) != getpgid(0))
-		kill (- getpgid(0), SIGTTIN);
-
-
-	if (tcsetpgrp(STDIN_FILENO, getpid()) == -1)
-	{
-		perror(flip_table " yash: abort reason: Couldn't obtain control of the terminal");
-		return 0;
-	}
-
-
-	tcgetattr (STDIN_FILENO, &shell_tmodes);
-
-
-	atexit(exit_handler);
-
-
-	if (signal(SIGINT, signal_handler) == SIG_ERR)	perror(blank_face " yash: signal");
-	if (signal(SIGTSTP, signal_handler) == SIG_ERR) perror(blank_face " yash: signal");
-
-	if (signal (SIGCHLD, SIG_DFL) == SIG_ERR)		perror(blank_face " yash: signal");
-
-	if (signal (SIGQUIT, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
-	if (signal (SIGTTIN, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
-	if (signal (SIGTTOU, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
-
-
-	Job* j = NULL;
-	while (prompt())
-	{
-		char** tokens = set_tokens(" \t");
-
-		if (no_tokens(tokens))
-			continue;
-
-		if (launch_builtin(tokens))
-			continue;
-
-		j = make_Job(tokens);
-		if (j == NULL)
-			continue;
-		j->next = current_Job;
-		current_Job = j;
-
-		launch_Job(current_Job);
-		if (current_Job->foreground)
-			wait_Job(current_Job);
-	}
-
-
-	return 0;
-}
-#endif
+#ifndef JOB_CONTROL_H
+#define JOB_CONTROL_H
+
+#include <unistd.h>			// fork, pid_t, execvp
+#include <signal.h>			// SIGINT, SIGTSTP, signal, SIG_ERR
+#include <sys/wait.h>		// wait4
+#include <sys/resource.h>	// struct rusage
+#include <sys/signalfd.h>	// signalfd, struct signalfd_siginfo
+#include <stdio.h>			// fprintf, perror
+#include <errno.h>			// ECHILD
+#include <string.h>			// strcpy, strcasecmp, strerror
+#include <ctype.h>			// isdigit
+#include <limits.h>			// INT_MAX
+#include <termios.h>		// tcsetattr, tcgetattr
+#include <dirent.h>			// opendir, readdir
+#include <stddef.h>			// offsetof
+#include "job.h"
+#include "events.h"
+#include "watchdog.h"
+#include "queue.h"
+#include "live.h"
+#include <assert.h>			// assert
+#include "faces.h"
+
+
+static int is_State (Job* j, State s)
+{
+	if (s == Error_State)
+	{
+		for (Process* p= j->p; p != NULL; p = p->next)
+			if (p->state == s)
+				return 1;
+		return 0;
+	}
+	else if (s == Running_State)
+	{
+		for (Process* p= j->p; p != NULL; p = p->next)
+			if (p->state != s)
+				return 0;
+		return 1;
+	}
+	else
+	{
+		for (Process* p= j->p; p != NULL; p = p->next)
+			if (p->state < s)
+			{
+				// fprintf(stderr, "Job (%s) not %s: %s\n", j->command, get_state_string(s), get_state_string(p->state));
+				return 0;
+			}
+		// fprintf(stderr, "Job (%s) is %s\n", j->command, get_state_string(s));
+		return 1;
+	}
+}
+
+int is_Error (Job* j)
+{
+	return is_State(j, Error_State);
+}
+
+int is_Running (Job* j)
+{
+	return is_State(j, Running_State);
+}
+
+int is_Stopped (Job* j)
+{
+	return is_State(j, Stopped_State);
+}
+
+int is_Done (Job* j)
+{
+	return is_State(j, Done_State);
+}
+
+Process* find_Process (pid_t pid)
+{
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		for (Process* p = j->p; p != NULL; p = p->next)
+			if (p->pid == pid)
+				return p;
+
+	return NULL;
+}
+
+Job* find_Job (pid_t pid)
+{
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		for (Process* p = j->p; p != NULL; p = p->next)
+			if (p->pid == pid)
+				return j;
+
+	return NULL;
+}
+
+int count_Jobs (Job* j)
+{
+	int result = 0;
+	for (; j != NULL; j = j->next)
+		result++;
+
+	return result;
+}
+
+static void update_Process (Process* p, int status, const struct rusage* usage)
+{
+	assert (p != NULL);
+
+	if (WIFEXITED(status) || WIFSIGNALED(status))
+	{
+		p->usage = *usage;
+		p->end_ns = get_monotonic_ns();
+	}
+
+	if (WIFSTOPPED(status))
+	{
+		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Stopped_State));
+		p->state = Stopped_State;
+	}
+	else if (WIFEXITED(status))
+	{
+		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Done_State));
+		p->state = Done_State;
+		p->status = status;
+	}
+	else if (WIFSIGNALED(status))
+	{
+		p->status = status;
+		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Done_State));
+		p->state = Done_State;
+	}
+	else
+	{
+		// fprintf(stderr, "Marking (%d): %s\n", p->pid, get_state_string(Error_State));
+		p->state = Error_State;
+	}
+}
+
+/* Shell-style exit status of a finished job (128+signal if killed).
+   Like "set -o pipefail": the rightmost stage that failed decides. */
+int get_exit_status (Job* j)
+{
+	int result = 0;
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		if (p->state == Error_State)
+			result = 1;
+		else if (WIFEXITED(p->status) && WEXITSTATUS(p->status) != 0)
+			result = WEXITSTATUS(p->status);
+		else if (WIFSIGNALED(p->status))
+			result = 128 + WTERMSIG(p->status);
+	}
+
+	return result;
+}
+
+static long long sigchld_wake_ns = 0;	// inside on_SIGCHLD: when the event loop woke up for it
+
+/* Collect every child that changed state, without blocking.
+   Returns -1 (errno ECHILD) when the shell has no children left. */
+static int reap_Processes ()
+{
+	pid_t pid;
+	int status;
+	struct rusage usage;
+
+	while ((pid = wait4(WAIT_ANY, &status, WUNTRACED|WNOHANG, &usage)) > 0)
+	{
+		Process* p = find_Process(pid);
+		if (p == NULL)
+			continue;
+		update_Process(p, status, &usage);
+		if (sigchld_wake_ns != 0)
+			record_Stat(Reap_Lag_Stat, get_monotonic_ns() - sigchld_wake_ns);
+
+		long long exec_ns = read_Exec_Slot(p->exec_slot, pid);
+		if (exec_ns != 0)
+		{
+			record_Stat(Spawn_Stat, exec_ns - p->start_ns);
+			p->exec_slot = -1;
+		}
+
+		Job* j = find_Job(pid);
+		trace_Event(WIFSTOPPED(status) ? Trace_Stop : Trace_Reap, 0, j->pgid, pid);
+		if (!WIFSTOPPED(status))
+			processes_reaped++;
+		if (j->end_ns == 0 && !is_Alive(j))
+		{
+			jobs_finished++;
+			j->end_ns = get_monotonic_ns();
+			j->shell_cpu = get_shell_cpu() - j->shell_cpu;
+			record_Stat(Job_Stat, j->end_ns - j->start_ns);
+		}
+	}
+
+	if (pid == -1 && errno != ECHILD)
+		perror(blank_face " yash: wait4");
+
+	return (pid == -1) ? -1 : 0;
+}
+
+static int sigchld_fd = -1;
+
+static void on_SIGCHLD (int fd, short revents, void* data)
+{
+	struct signalfd_siginfo info;
+	while (read(fd, &info, sizeof(info)) == sizeof(info))
+		; // drain: one reap collects every child
+
+	sigchld_wake_ns = wake_ns;
+	reap_Processes();
+	sigchld_wake_ns = 0;
+	dispatch_Queue(); // a slot may have freed up
+}
+
+/* Route SIGCHLD through a signalfd so that waiting on children is one more event in
+   the shell's event loop. Children unblock it again in launch_Process. */
+int watch_Children ()
+{
+	if (sigchld_fd != -1)
+		return 0;
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+	{
+		perror(blank_face " yash: sigprocmask");
+		return -1;
+	}
+
+	sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+	if (sigchld_fd == -1)
+	{
+		perror(blank_face " yash: signalfd");
+		return -1;
+	}
+
+	return add_Event(sigchld_fd, POLLIN, on_SIGCHLD, NULL);
+}
+
+static void get_Job_status (Job* j, int WAIT)
+{
+	if (j == NULL)
+		return;
+
+	watch_Children();
+
+	if (reap_Processes() == -1 && WAIT)
+		mark_Job(j, Done_State); // hack: Mark Job as Done... Somehow it skipped being a zombie
+
+	while (WAIT && !is_Stopped(j) && !is_Error(j))
+	{
+		if (wait_Events(-1, -1) == -1 && errno != EINTR)
+		{
+			perror(blank_face " yash: poll");
+			return;
+		}
+
+		if (reap_Processes() == -1)
+			mark_Job(j, Done_State);
+	}
+
+	if (is_Error(j))
+	{
+		j->state = Error_State;
+		return;
+	}
+
+	if (!is_Stopped(j))
+		return; // Still Running
+
+	if (is_Done(j))
+		j->state = Done_State;
+	else
+	{
+		if (WAIT && j->foreground)
+			tcgetattr(STDIN_FILENO, &j->tmodes); // save Job's terminal modes
+		j->state = Stopped_State;
+	}
+}
+
+void update_Job (Job* j)
+{
+	// fprintf(stderr, "Entering %s\n", __PRETTY_FUNCTION__);
+	get_Job_status(j, 0);
+}
+
+void update_Jobs ()
+{
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		update_Job(j);
+}
+
+#define JOB_STRING_SIZE 1+32+1+1+2+24+2+2+1
+static char* get_Job_string (Job* j)
+{
+	static char buffer[JOB_STRING_SIZE+1];
+	char state[24+1];
+
+	if (j->reason != NULL && j->state == Done_State)
+		snprintf(state, sizeof(state), "Killed (%s)", j->reason);
+	else
+		snprintf(state, sizeof(state), "%s", get_state_string(j->state));
+
+	sprintf(buffer,
+			"[%d]%c  %-24s%%s %c\n",
+			j->index,
+			(j == current_Job) ? '+' : '-',
+			state,
+			// fill in [ j->command ] using printf
+			j->foreground ? ' ' : '&'
+			);
+
+	return buffer;
+}
+
+void print_Job (Job* j)
+{
+	printf(get_Job_string(j), j->command);
+}
+
+void wait_Job (Job* j)
+{
+	// fprintf(stderr, "Entering %s\n", __PRETTY_FUNCTION__);
+	get_Job_status(j, 1);
+
+	/* ^Z: say so right away, on a line of its own after the echoed "^Z". In a script
+	   too (SIGTTIN, SIGSTOP): the job stays behind instead of running. */
+	if (j->state == Stopped_State)
+	{
+		if (interactive)
+			printf("\n");
+		print_Job(j);
+	}
+}
+
+/* Unlink j from the job table and free it */
+void remove_Job (Job* j)
+{
+	Job** link = &current_Job;
+	while (*link != NULL && *link != j)
+		link = &(*link)->next;
+
+	if (*link == NULL)
+		return;
+
+	*link = j->next;
+	stop_Watchdog(j);
+	destroy_Job(j);
+	Job_count--;
+}
+
+/* "1.2M" from kilobytes (fits in 24 bytes, whatever kb is) */
+static const char* format_kb (long kb, char* buffer, size_t size)
+{
+	if (kb >= 1024 * 1024)
+		snprintf(buffer, size, "%.1fG", kb / (1024.0 * 1024));
+	else if (kb >= 1024)
+		snprintf(buffer, size, "%.1fM", kb / 1024.0);
+	else
+		snprintf(buffer, size, "%ldK", kb);
+	return buffer;
+}
+
+/* "time" report of a finished job, on stderr: wall time from the first fork to the
+   last reap, each stage's own wall/user/sys/maxrss, and the shell's overhead
+   (its time in launch_Job, and the CPU it used itself until the last reap). */
+void print_Job_time (Job* j)
+{
+	double real = (j->end_ns - j->start_ns) / 1e9;
+
+	if (j->timed == Json_Time)
+	{
+		fprintf(stderr, "{\"command\": ");
+		print_json_string(stderr, j->command);
+		fprintf(stderr, ", \"status\": %d, \"real_s\": %.6f, \"launch_s\": %.6f, \"shell_cpu_s\": %.6f, \"stages\": [",
+			get_exit_status(j), real, j->launch_ns / 1e9, j->shell_cpu);
+
+		for (Process* p = j->p; p != NULL; p = p->next)
+		{
+			char* command = concat_tokens(p->argv, " ");
+			fprintf(stderr, "%s{\"command\": ", p == j->p ? "" : ", ");
+			print_json_string(stderr, command != NULL ? command : "");
+			fprintf(stderr, ", \"pid\": %d, \"status\": %d, \"real_s\": %.6f, \"user_s\": %.6f, \"sys_s\": %.6f, \"maxrss_kb\": %ld}",
+				p->pid, WIFSIGNALED(p->status) ? 128 + WTERMSIG(p->status) : WEXITSTATUS(p->status),
+				(p->end_ns - p->start_ns) / 1e9,
+				p->usage.ru_utime.tv_sec + p->usage.ru_utime.tv_usec / 1e6,
+				p->usage.ru_stime.tv_sec + p->usage.ru_stime.tv_usec / 1e6,
+				p->usage.ru_maxrss);
+			free(command);
+		}
+		fprintf(stderr, "]}\n");
+		return;
+	}
+
+	fprintf(stderr, "\nreal %.3fs   (shell: launch %.3fms, cpu %.3fms)\n", real, j->launch_ns / 1e6, j->shell_cpu * 1e3);
+	fprintf(stderr, "%10s %9s %9s %8s %7s  %s\n", "real", "user", "sys", "maxrss", "status", "stage");
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		char rss[24];
+		char* command = concat_tokens(p->argv, " ");
+		fprintf(stderr, "%9.3fs %8.3fs %8.3fs %8s %7d  %s\n",
+			(p->end_ns - p->start_ns) / 1e9,
+			p->usage.ru_utime.tv_sec + p->usage.ru_utime.tv_usec / 1e6,
+			p->usage.ru_stime.tv_sec + p->usage.ru_stime.tv_usec / 1e6,
+			format_kb(p->usage.ru_maxrss, rss, sizeof(rss)),
+			WIFSIGNALED(p->status) ? 128 + WTERMSIG(p->status) : WEXITSTATUS(p->status),
+			command != NULL ? command : "");
+		free(command);
+	}
+}
+
+/* set -o slow: one line on stderr for a job that ran for slow_ms or longer. CPU and
+   maxrss are summed over the stages; the status is each stage's, in order. */
+void print_Job_slow (Job* j)
+{
+	double cpu = 0;
+	long maxrss = 0;
+	char status[128] = "";
+	size_t used = 0;
+
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		cpu += p->usage.ru_utime.tv_sec + p->usage.ru_stime.tv_sec + (p->usage.ru_utime.tv_usec + p->usage.ru_stime.tv_usec) / 1e6;
+		maxrss += p->usage.ru_maxrss;
+
+		char stage[16];
+		if (p->state == Error_State)
+			snprintf(stage, sizeof(stage), "-");
+		else
+			snprintf(stage, sizeof(stage), "%d", WIFSIGNALED(p->status) ? 128 + WTERMSIG(p->status) : WEXITSTATUS(p->status));
+		if (used < sizeof(status))
+			used += snprintf(status + used, sizeof(status) - used, "%s%s", p == j->p ? "" : "|", stage);
+	}
+
+	char rss[24];
+	fprintf(stderr, "[%d] slow: %.2fs real, %.2fs cpu, %s maxrss, status %s  %s\n", j->index,
+		(j->end_ns - j->start_ns) / 1e9, cpu, format_kb(maxrss, rss, sizeof(rss)), status, j->command);
+}
+
+/* Delete Done/Error jobs */
+void clean_Jobs(int UPDATE_FIRST)
+{
+	if (UPDATE_FIRST)
+		update_Jobs();
+
+	Job* next = NULL;
+	for (Job* j = current_Job; j != NULL; j = next)
+	{
+		next = j->next;
+		switch (j->state)
+		{
+			case Queued_State:
+			case Running_State:
+			case Stopped_State:
+				break;
+			case Error_State:
+			case Done_State:
+				if (j->timed != No_Time)
+					print_Job_time(j);
+				else if (slow_option && j->end_ns != 0 && j->end_ns - j->start_ns >= slow_ms * 1000000)
+					print_Job_slow(j);
+				remove_Job(j);
+		}
+	}
+}
+
+void print_Jobs (int LIST_ALL)
+{
+	update_Jobs();
+
+
+	char messages[Job_count][JOB_STRING_SIZE+1];
+	char* commands[Job_count];
+	int index = 0;
+
+
+	for (Job* j = current_Job; j != NULL; j = j->next)
+	{
+		switch (j->state)
+		{
+			case Queued_State:
+			case Running_State:
+			case Stopped_State:
+				if (LIST_ALL)
+				{
+					strcpy(messages[index], get_Job_string(j));
+					commands[index++] = j->command;
+				}
+				break;
+			case Error_State:
+			case Done_State:
+				if (LIST_ALL || !j->foreground)
+				{
+					strcpy(messages[index], get_Job_string(j));
+					commands[index++] = j->command;
+				}
+		}
+	}
+
+
+	/* Print in reverse order (oldest to newest) */
+	for (int i=index-1; 0<=i; --i)
+		printf(messages[i], commands[i]);
+
+
+	clean_Jobs(0);
+}
+
+/* CPU time of a live process, in clock ticks. Returns -1 if it's gone. */
+int read_proc_times (pid_t pid, unsigned long long* utime, unsigned long long* stime)
+{
+	/* "pid (comm) state ppid ... cmajflt utime stime ...": comm may contain anything, so skip to the last ')' */
+	char path[64], line[512];
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	FILE* f = fopen(path, "re");
+	if (f == NULL)
+		return -1;
+	char* fields = (fgets(line, sizeof(line), f) != NULL) ? strrchr(line, ')') : NULL;
+	fclose(f);
+
+	if (fields == NULL || sscanf(fields, ") %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", utime, stime) != 2)
+		return -1;
+
+	return 0;
+}
+
+/* Resource usage of a process: from wait4 once it is Done, else read live from /proc */
+static struct rusage get_Process_usage (Process* p)
+{
+	if (p->state != Running_State && p->state != Stopped_State)
+		return p->usage;
+
+	struct rusage usage;
+	memset(&usage, 0, sizeof(usage));
+	if (p->pid <= 0)
+		return usage;
+
+	unsigned long long utime, stime;
+	if (read_proc_times(p->pid, &utime, &stime) == 0)
+	{
+		long ticks = sysconf(_SC_CLK_TCK);
+		usage.ru_utime.tv_sec = utime / ticks;
+		usage.ru_utime.tv_usec = (utime % ticks) * 1000000 / ticks;
+		usage.ru_stime.tv_sec = stime / ticks;
+		usage.ru_stime.tv_usec = (stime % ticks) * 1000000 / ticks;
+	}
+
+	usage.ru_maxrss = read_proc_value(p->pid, "status", "VmHWM:");
+	usage.ru_nvcsw = read_proc_value(p->pid, "status", "voluntary_ctxt_switches:");
+	usage.ru_nivcsw = read_proc_value(p->pid, "status", "nonvoluntary_ctxt_switches:");
+	usage.ru_inblock = read_proc_value(p->pid, "io", "read_bytes:") / 512;
+	usage.ru_oublock = read_proc_value(p->pid, "io", "write_bytes:") / 512;
+
+	return usage;
+}
+
+static void add_usage (struct rusage* total, const struct rusage* u)
+{
+	total->ru_utime.tv_sec += u->ru_utime.tv_sec;
+	total->ru_utime.tv_usec += u->ru_utime.tv_usec;
+	total->ru_stime.tv_sec += u->ru_stime.tv_sec;
+	total->ru_stime.tv_usec += u->ru_stime.tv_usec;
+	total->ru_maxrss += u->ru_maxrss;
+	total->ru_nvcsw += u->ru_nvcsw;
+	total->ru_nivcsw += u->ru_nivcsw;
+	total->ru_inblock += u->ru_inblock;
+	total->ru_oublock += u->ru_oublock;
+}
+
+/* Job totals over every stage (maxrss: sum of each stage's peak) */
+struct rusage get_Job_usage (Job* j)
+{
+	struct rusage total;
+	memset(&total, 0, sizeof(total));
+
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		struct rusage u = get_Process_usage(p);
+		add_usage(&total, &u);
+	}
+
+	return total;
+}
+
+static void print_usage_line (const char* pid, const char* state, const struct rusage* u, const char* command)
+{
+	char rss[24], csw[32], io[32];
+	snprintf(csw, sizeof(csw), "%ld/%ld", u->ru_nvcsw, u->ru_nivcsw);
+	snprintf(io, sizeof(io), "%ld/%ld", u->ru_inblock, u->ru_oublock);
+
+	printf("    %7s  %-10s %8.2fs %8.2fs %7s %13s %15s%s%s\n", pid, state,
+		u->ru_utime.tv_sec + u->ru_utime.tv_usec / 1e6, u->ru_stime.tv_sec + u->ru_stime.tv_usec / 1e6,
+		format_kb(u->ru_maxrss, rss, sizeof(rss)), csw, io, command != NULL && *command ? "  " : "", command != NULL ? command : "");
+}
+
+/* jobs -l: every job, then a line per stage (and per "|>" edge) and the job's totals */
+void print_Jobs_long ()
+{
+	update_Jobs();
+
+	int n = count_Jobs(current_Job), index = 0;
+	Job* jobs[n+1];
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		jobs[index++] = j;
+
+	if (n > 0)
+		printf("    %7s  %-10s %9s %9s %7s %13s %15s  %s\n",
+			"PID", "STATE", "USER", "SYS", "MAXRSS", "CSW vol/inv", "IO blk in/out", "COMMAND");
+
+	/* Oldest to newest */
+	for (int i = n-1; 0 <= i; --i)
+	{
+		Job* j = jobs[i];
+		print_Job(j);
+
+		for (Process* p = j->p; p != NULL; p = p->next)
+		{
+			/* "|>" edge into this stage */
+			if (p->relay != NULL)
+			{
+				char bytes[16], rate[16];
+				printf("    %7s  |> %s relayed, %s%s\n", "", format_bytes(p->relay->bytes, bytes, sizeof(bytes)),
+					format_rate(get_Relay_rate(p->relay), rate, sizeof(rate)), (p->relay->in == -1) ? " average" : "");
+			}
+
+			char pid[16], state[16];
+			snprintf(pid, sizeof(pid), "%d", p->pid);
+			if (p->state == Done_State && WIFSIGNALED(p->status))
+				snprintf(state, sizeof(state), "Killed(%d)", WTERMSIG(p->status));
+			else if (p->state == Done_State)
+				snprintf(state, sizeof(state), "Done(%d)", WEXITSTATUS(p->status));
+			else
+				snprintf(state, sizeof(state), "%s", get_state_string(p->state));
+
+			struct rusage u = get_Process_usage(p);
+			char* command = concat_tokens(p->argv, " ");
+			print_usage_line(pid, state, &u, command);
+			free(command);
+		}
+
+		if (j->p != NULL && j->p->next != NULL)
+		{
+			struct rusage total = get_Job_usage(j);
+			print_usage_line("", "total", &total, "");
+		}
+	}
+
+	clean_Jobs(0);
+}
+
+/* Every thread of every process in the job's pgid: stages fork children of their own
+   (make, xargs, ...), which set_Sched_Class on the stage pids alone would miss. */
+static int set_Job_Sched (Job* j, Sched_Class c)
+{
+	DIR* proc = opendir("/proc");
+	if (proc == NULL)
+		return -1;
+
+	int result = 0;
+	for (struct dirent* e = readdir(proc); e != NULL; e = readdir(proc))
+	{
+		if (!isdigit((unsigned char) e->d_name[0]))
+			continue;
+
+		/* "pid (comm) state ppid pgrp ...": comm may contain anything, so skip to the last ')' */
+		char path[300], line[512];
+		snprintf(path, sizeof(path), "/proc/%s/stat", e->d_name);
+		FILE* f = fopen(path, "re");
+		if (f == NULL)
+			continue;
+		char* fields = (fgets(line, sizeof(line), f) != NULL) ? strrchr(line, ')') : NULL;
+		fclose(f);
+
+		int ppid, pgrp;
+		if (fields == NULL || sscanf(fields, ") %*c %d %d", &ppid, &pgrp) != 2 || pgrp != j->pgid)
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%s/task", e->d_name);
+		DIR* tasks = opendir(path);
+		if (tasks == NULL)
+			continue;
+		for (struct dirent* t = readdir(tasks); t != NULL; t = readdir(tasks))
+			if (isdigit((unsigned char) t->d_name[0]) && set_Sched_Class(atoi(t->d_name), c) == -1)
+				result = -1;
+		closedir(tasks);
+	}
+
+	closedir(proc);
+	return result;
+}
+
+static void fg ()
+{
+	Job* j;
+
+	for (j = current_Job; j != NULL; j = j->next)
+	{
+		if (j->state == Running_State)
+			if (!j->foreground)
+				break;
+		if (j->state == Stopped_State)
+			break;
+	}
+
+	if (j == NULL)
+	{
+		fprintf(stderr, "yash: fg: current: no such job\n");
+		return;
+	}
+
+
+	if (j->sched != Normal_Sched)
+	{
+		if (set_Job_Sched(j, Normal_Sched) == -1)
+			perror(blank_face " yash: fg: restoring normal scheduling");
+		j->sched = Normal_Sched;
+	}
+
+
+	int save_Stopped_State = j->state == Stopped_State;
+	j->foreground = 1;
+	mark_Job(j, Running_State);
+	print_Job(j);
+
+
+	if (save_Stopped_State)
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &j->tmodes); // restore Jobs terminal modes
+	tcsetpgrp(STDIN_FILENO, j->pgid);
+	trace_Event(Trace_Tcsetpgrp, 0, j->pgid, 0);
+
+
+	kill(- j->pgid, SIGCONT);
+	trace_Event(Trace_Continue, 0, j->pgid, 0);
+	wait_Job(j);
+}
+
+static void bg ()
+{
+	Job* j;
+
+	for (j = current_Job; j != NULL; j = j->next)
+		if (j->state == Stopped_State)
+			break;
+
+	if (j == NULL)
+	{
+		fprintf(stderr, "yash: bg: current: no such job\n");
+		return;
+	}
+
+	j->foreground = 0;
+	mark_Job(j, Running_State);
+
+	if (j->sched == Normal_Sched && bgsched_option != Normal_Sched)
+	{
+		j->sched = bgsched_option;
+		if (set_Job_Sched(j, j->sched) == -1)
+			perror(blank_face " yash: bg: bgsched");
+	}
+
+	print_Job(j);
+	kill(- j->pgid, SIGCONT);
+	trace_Event(Trace_Continue, 0, j->pgid, 0);
+}
+
+static const struct
+{
+	const char* name;
+	int signo;
+} signal_names[] =
+{
+	{"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT}, {"ILL", SIGILL},
+	{"TRAP", SIGTRAP}, {"ABRT", SIGABRT}, {"BUS", SIGBUS},   {"FPE", SIGFPE},
+	{"KILL", SIGKILL}, {"USR1", SIGUSR1}, {"SEGV", SIGSEGV}, {"USR2", SIGUSR2},
+	{"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CHLD", SIGCHLD},
+	{"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN},
+	{"TTOU", SIGTTOU}, {"URG", SIGURG},   {"XCPU", SIGXCPU}, {"XFSZ", SIGXFSZ},
+	{"VTALRM", SIGVTALRM}, {"PROF", SIGPROF}, {"WINCH", SIGWINCH}, {"SYS", SIGSYS},
+	{NULL, 0}
+};
+
+/* Accepts "9", "KILL", "kill" or "SIGKILL". Returns -1 if unknown. */
+static int get_signal (const char* name)
+{
+	if (isdigit((unsigned char) name[0]))
+	{
+		char* end;
+		long signo = strtol(name, &end, 10);
+		return (*end == 0 && signo < NSIG) ? (int) signo : -1;
+	}
+
+	if (strncasecmp(name, "SIG", 3) == 0)
+		name += 3;
+
+	for (int i=0; signal_names[i].name != NULL; i++)
+		if (strcasecmp(name, signal_names[i].name) == 0)
+			return signal_names[i].signo;
+
+	return -1;
+}
+
+/* Job specs: %N (index), %+ or %% (current), %- (previous), %string (command prefix) */
+Job* find_Job_spec (const char* spec)
+{
+	if (spec[0] != '%')
+		return NULL;
+	spec++;
+
+	if (spec[0] == 0 || strcmp(spec, "+") == 0 || strcmp(spec, "%") == 0)
+		return current_Job;
+
+	if (strcmp(spec, "-") == 0)
+		return (current_Job != NULL) ? current_Job->next : NULL;
+
+	if (isdigit((unsigned char) spec[0]))
+	{
+		int index = atoi(spec);
+		for (Job* j = current_Job; j != NULL; j = j->next)
+			if (j->index == index)
+				return j;
+		return NULL;
+	}
+
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		if (strncmp(j->command, spec, strlen(spec)) == 0)
+			return j;
+
+	return NULL;
+}
+
+/* Returns -1 (errno set) if kill failed, -2 if the job has no process group yet */
+static int signal_Job (Job* j, int signo)
+{
+	/* Not launched yet: anything but a stop/continue takes it out of the queue */
+	if (j->state == Queued_State)
+	{
+		if (signo != SIGCONT && signo != SIGSTOP && signo != SIGTSTP && signo != 0)
+		{
+			mark_Job(j, Done_State);
+			j->reason = "dequeued";
+		}
+		return 0;
+	}
+
+	if (j->pgid == 0)
+		return -2;
+	if (kill(- j->pgid, signo) == -1)
+		return -1;
+
+	/* A stopped job won't act on these until it is continued */
+	if (j->state == Stopped_State && (signo == SIGTERM || signo == SIGHUP || signo == SIGKILL))
+	{
+		kill(- j->pgid, SIGCONT);
+		mark_Job(j, Running_State); // so that the next update polls it
+	}
+
+	if (signo == SIGCONT)
+	{
+		mark_Job(j, Running_State);
+		trace_Event(Trace_Continue, 0, j->pgid, 0);
+	}
+	else if (signo != SIGSTOP && signo != SIGTSTP)
+		j->foreground = 0; // killed by the user: report it at the next prompt
+
+	return 0;
+}
+
+/* kill [-s sig | -sig] %job|pid ...
+   kill -l
+   Every target is signaled from the shell: one kill(-pgid) per job, no fork. */
+static void kill_builtin (char** args)
+{
+	int signo = SIGTERM, status;
+
+	if (!no_tokens(args) && strcmp(args[0], "-l") == 0)
+	{
+		for (int i=0; signal_names[i].name != NULL; i++)
+			printf("%2d) SIG%-8s%c", signal_names[i].signo, signal_names[i].name, (i % 4 == 3) ? '\n' : ' ');
+		printf("\n");
+		return;
+	}
+
+	if (!no_tokens(args) && strcmp(args[0], "-s") == 0)
+	{
+		if (args[1] == NULL || (signo = get_signal(args[1])) == -1)
+		{
+			fprintf(stderr, "yash: kill: %s: invalid signal specification\n", args[1] ? args[1] : "-s");
+			return;
+		}
+		args += 2;
+	}
+	else if (!no_tokens(args) && args[0][0] == '-' && args[0][1] != 0 && strcmp(args[0], "--") != 0)
+	{
+		if ((signo = get_signal(&args[0][1])) == -1)
+		{
+			fprintf(stderr, "yash: kill: %s: invalid signal specification\n", &args[0][1]);
+			return;
+		}
+		args++;
+	}
+
+	if (!no_tokens(args) && strcmp(args[0], "--") == 0)
+		args++;
+
+	if (no_tokens(args))
+	{
+		fprintf(stderr, "yash: kill: usage: kill [-s sigspec | -sigspec] pid | jobspec ... or kill -l\n");
+		return;
+	}
+
+	for (; *args != NULL; args++)
+	{
+		if (args[0][0] == '%')
+		{
+			Job* j = find_Job_spec(*args);
+			if (j == NULL)
+				fprintf(stderr, "yash: kill: %s: no such job\n", *args);
+			else if ((status = signal_Job(j, signo)) == -2)
+				fprintf(stderr, "yash: kill: %s: job has not started\n", *args);
+			else if (status == -1)
+				fprintf(stderr, "yash: kill: %s: %s\n", *args, strerror(errno));
+			continue;
+		}
+
+		char* end;
+		long pid = strtol(*args, &end, 10);
+		if (*end != 0 || end == *args)
+			fprintf(stderr, "yash: kill: %s: arguments must be process or job IDs\n", *args);
+		else if (kill((pid_t) pid, signo) == -1)
+			fprintf(stderr, "yash: kill: (%ld) - %s\n", pid, strerror(errno));
+		else if (signo != SIGCONT && signo != SIGSTOP && signo != SIGTSTP && signo != 0)
+		{
+			Job* j = find_Job((pid_t) pid);
+			if (j != NULL)
+				j->foreground = 0; // as signal_Job does: report it at the next prompt
+		}
+	}
+}
+
+/* Block (in the event loop) until every job in jobs[] -- or, with ANY, the first one --
+   is no longer running. Returns -1 if timeout_ms (when not negative) ran out first, or
+   on ^C (interrupted is left set). */
+int wait_Jobs (Job** jobs, int count, int ANY, int timeout_ms)
+{
+	long long deadline = get_monotonic_ns() + timeout_ms * 1000000LL;
+
+	interrupted = 0;
+	watch_Children();
+	reap_Processes();
+
+	while (!interrupted)
+	{
+		int finished = 0;
+		for (int i=0; i < count; i++)
+			if (is_Stopped(jobs[i]) || is_Error(jobs[i]))
+				finished++;
+
+		if (finished == count || (ANY && finished > 0))
+			break;
+
+		int remaining = -1;
+		if (timeout_ms >= 0)
+		{
+			remaining = (deadline - get_monotonic_ns() + 999999) / 1000000;
+			if (remaining <= 0)
+				return -1;
+		}
+
+		if (wait_Events(remaining, -1) == -1 && errno != EINTR)
+		{
+			perror(blank_face " yash: poll");
+			return -1;
+		}
+	}
+
+	for (int i=0; i < count; i++)
+		update_Job(jobs[i]);
+
+	return interrupted ? -1 : 0;
+}
+
+/* wait [-n] [-t ms] [%job|pid ...]
+   Without targets, waits for every running job. */
+static void wait_builtin (char** args)
+{
+	int ANY = 0;
+	int timeout_ms = -1;
+
+	for (; *args != NULL && args[0][0] == '-'; args++)
+	{
+		if (strcmp(*args, "-n") == 0)
+			ANY = 1;
+		else if (strcmp(*args, "-t") == 0 && args[1] != NULL)
+		{
+			char* end;
+			long ms = strtol(*++args, &end, 10);
+			if (end == *args || *end != 0 || ms < 0 || ms > INT_MAX)
+			{
+				fprintf(stderr, "yash: wait: %s: not a number of ms\n", *args);
+				return;
+			}
+			timeout_ms = ms;
+		}
+		else if (strcmp(*args, "--") == 0)
+		{
+			args++;
+			break;
+		}
+		else
+		{
+			fprintf(stderr, "yash: wait: usage: wait [-n] [-t ms] [%%job | pid ...]\n");
+			return;
+		}
+	}
+
+	Job* jobs[count_Jobs(current_Job)+1];
+	int count = 0;
+
+	if (no_tokens(args))
+	{
+		for (Job* j = current_Job; j != NULL; j = j->next)
+			if (j->state == Running_State || j->state == Queued_State)
+				jobs[count++] = j;
+	}
+	else
+		for (; *args != NULL; args++)
+		{
+			Job* j = (args[0][0] == '%') ? find_Job_spec(*args) : find_Job(atoi(*args));
+			if (j == NULL)
+				fprintf(stderr, "yash: wait: %s: no such job\n", *args);
+			else
+				jobs[count++] = j;
+		}
+
+	if (count == 0)
+		return;
+
+	if (wait_Jobs(jobs, count, ANY, timeout_ms) == -1)
+	{
+		if (interrupted)
+			fprintf(stderr, "yash: wait: interrupted\n");
+		else if (timeout_ms >= 0)
+			fprintf(stderr, "yash: wait: timed out after %d ms\n", timeout_ms);
+	}
+}
+
+
+/* set -o live (live.h): publish to /dev/shm/yash.<pid> every LIVE_INTERVAL_MS.
+   The /proc reads for the job table happen before the write starts, so the seqlock
+   is only held for a memcpy. */
+
+static Live_Segment* live_segment = NULL;
+static int live_timer_fd = -1;
+
+/* The state the job would be printed with, without reaping anything */
+static State get_live_state (Job* j)
+{
+	if (j->state == Queued_State)
+		return Queued_State;
+	if (j->state == Error_State || is_Error(j))
+		return Error_State;
+	if (is_Done(j))
+		return Done_State;
+	if (is_Stopped(j))
+		return Stopped_State;
+	return Running_State;
+}
+
+static void snapshot_Live_Job (Job* j, Live_Job* l)
+{
+	l->index = j->index;
+	l->pgid = j->pgid;
+	snprintf(l->state, sizeof(l->state), "%s", get_state_string(get_live_state(j)));
+	l->foreground = j->foreground;
+	snprintf(l->command, sizeof(l->command), "%s", j->command);
+
+	long ticks = sysconf(_SC_CLK_TCK);
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		l->stages++;
+		unsigned long long utime, stime;
+
+		if (p->state != Running_State && p->state != Stopped_State)
+		{
+			l->cpu_s += p->usage.ru_utime.tv_sec + p->usage.ru_stime.tv_sec
+				+ (p->usage.ru_utime.tv_usec + p->usage.ru_stime.tv_usec) / 1e6;
+			l->rss_kb += p->usage.ru_maxrss;
+		}
+		else if (p->pid > 0 && read_proc_times(p->pid, &utime, &stime) == 0)
+		{
+			l->cpu_s += (double) (utime + stime) / ticks;
+			l->rss_kb += read_proc_value(p->pid, "statm", NULL) / 1024;
+		}
+	}
+
+	if (j->start_ns != 0)
+		l->runtime_s = ((j->end_ns != 0) ? j->end_ns : get_monotonic_ns()) - j->start_ns;
+	l->runtime_s /= 1e9;
+}
+
+static void publish_Live ()
+{
+	static Live_Segment next;
+	memset(&next, 0, sizeof(next));
+
+	next.shell_pid = live_segment->shell_pid;
+	next.shell_cpu_s = get_shell_cpu();
+	next.jobs_launched = jobs_launched;
+	next.jobs_finished = jobs_finished;
+	next.processes_forked = processes_forked;
+	next.processes_reaped = processes_reaped;
+
+	for (int s=0; s < STAT_COUNT && s < LIVE_MAX_STATS; s++, next.n_stats++)
+	{
+		Histogram* h = &histograms[s];
+		Live_Stat* l = &next.stats[s];
+		snprintf(l->name, sizeof(l->name), "%s", h->name);
+		l->count = h->count;
+		l->sum_ns = h->sum;
+		if (h->count == 0)
+			continue;
+		l->p50_ns = get_percentile(h, 0.5);
+		l->p90_ns = get_percentile(h, 0.9);
+		l->p99_ns = get_percentile(h, 0.99);
+		l->max_ns = h->max;
+	}
+
+	for (Job* j = current_Job; j != NULL && next.n_jobs < LIVE_MAX_JOBS; j = j->next)
+		snapshot_Live_Job(j, &next.jobs[next.n_jobs++]);
+
+	next.updated_ns = get_monotonic_ns();
+
+	/* Everything after the header: magic, version and seq stay the shell's */
+	size_t start = offsetof(Live_Segment, shell_pid);
+	begin_Live_write(live_segment);
+	memcpy((char*) live_segment + start, (char*) &next + start, sizeof(next) - start);
+	end_Live_write(live_segment);
+}
+
+static void on_Live_tick (int fd, short revents, void* data)
+{
+	unsigned long long expirations;
+	if (read(fd, &expirations, sizeof(expirations)) == -1)
+		return;
+
+	publish_Live();
+}
+
+/* Create or remove the segment to match set -o live. Called before every prompt
+   (and, with live_option cleared, at exit). */
+void update_Live ()
+{
+	if (live_option && live_segment == NULL)
+	{
+		if ((live_segment = create_Live(shell_pid)) == NULL)
+		{
+			live_option = 0;
+			return;
+		}
+
+		live_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (live_timer_fd == -1 || arm_timer(live_timer_fd, LIVE_INTERVAL_MS, 1) == -1
+			|| add_Event(live_timer_fd, POLLIN, on_Live_tick, NULL) == -1)
+			perror(blank_face " yash: live: timer");
+	}
+	else if (!live_option && live_segment != NULL)
+	{
+		if (live_timer_fd != -1)
+		{
+			remove_Event(live_timer_fd);
+			close(live_timer_fd);
+			live_timer_fd = -1;
+		}
+
+		remove_Live(live_segment);
+		live_segment = NULL;
+		return;
+	}
+
+	if (live_segment != NULL)
+		publish_Live();
+}
+
+#endif /* JOB_CONTROL_H */
+
+
+
+/* Test JOB_CONTROL */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <signal.h>			// kill, signal
+#include <stdio.h>			// printf, fflush, setvbuf, perror
+#include <unistd.h>			// isatty, setpgid, tcgetpgrp, tcsetpgrp, getpgid, getpid
+#include <stdlib.h>			// exit, atexit
+#include "tokenize.h"
+#include "job.h"
+#include "job_control.h"
+#include "builtins.h"
+#include "faces.h"
+#include <string.h>			// strcmp
+
+
+void exit_handler ()
+{
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		kill (- j->pgid, SIGHUP);
+	destroy_Job(current_Job);
+	printf("exit\n");
+}
+
+
+void signal_handler (int signo)
+{
+	switch(signo)
+	{
+		case SIGINT:
+		case SIGTSTP:
+			printf("\n# ");
+			fflush(stdout);
+	}
+}
+
+
+int prompt ()
+{
+	print_Jobs(0);
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes); // restore shell terminal modes
+	tcsetpgrp(STDIN_FILENO, shell_pid);
+
+	printf("# ");
+	return read_line(stdin) != NULL;
+}
+
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+
+	if (argc == 2 && strcmp(argv[1], "pikachu") == 0)
+		fprintf(stderr,
+			"\n"
+			"         YASH!"
+			pikachu "\n"
+			"(...and his best friend ^)\n\n"
+		);
+
+
+	if (!isatty(STDIN_FILENO))
+	{
+		fprintf(stderr, flip_table " yash: abort reason: Job control won't work because yash is not executing from a tty\n");
+		return 0;
+	}
+
+
+	shell_pid = getpid();
+	if (setpgid(0,0) == -1)
+	{
+		perror (flip_table " yash: abort reason: Couldn't put yash in its own process group");
+		return 0;
+	}
+	// printf("My pid: %d, pgid: %d\n", getpid(), getpgid(0));
+
+
+	while (tcgetpgrp (STDIN_FILENO) != getpgid(0))
+		kill (- getpgid(0), SIGTTIN);
+
+
+	if (tcsetpgrp(STDIN_FILENO, getpid()) == -1)
+	{
+		perror(flip_table " yash: abort reason: Couldn't obtain control of the terminal");
+		return 0;
+	}
+
+
+	tcgetattr (STDIN_FILENO, &shell_tmodes);
+
+
+	atexit(exit_handler);
+
+
+	if (signal(SIGINT, signal_handler) == SIG_ERR)	perror(blank_face " yash: signal");
+	if (signal(SIGTSTP, signal_handler) == SIG_ERR) perror(blank_face " yash: signal");
+
+	if (signal (SIGCHLD, SIG_DFL) == SIG_ERR)		perror(blank_face " yash: signal");
+
+	if (signal (SIGQUIT, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
+	if (signal (SIGTTIN, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
+	if (signal (SIGTTOU, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
+
+
+	Job* j = NULL;
+	while (prompt())
+	{
+		char** tokens = set_tokens(" \t");
+
+		if (no_tokens(tokens))
+			continue;
+
+		if (launch_builtin(tokens))
+			continue;
+
+		j = make_Job(tokens);
+		if (j == NULL)
+			continue;
+		j->next = current_Job;
+		current_Job = j;
+
+		launch_Job(current_Job);
+		if (current_Job->foreground)
+			wait_Job(current_Job);
+	}
+
+
+	return 0;
+}
+#endif
 /* Test JOB_CONTROL */
\ No newline at end of file
@@ -0,0 +1,325 @@
+#ifndef JOB_LIMITS_H
+#define JOB_LIMITS_H
+
+
+#include <sys/resource.h>	// setrlimit, setpriority, RLIMIT_*
+#include <sys/syscall.h>	// SYS_sched_setaffinity, SYS_ioprio_set
+#include <sched.h>			// sched_setscheduler, SCHED_OTHER
+#include <unistd.h>			// syscall
+#include <stdio.h>			// fprintf, perror
+#include <stdlib.h>			// calloc, free, strtol
+#include <string.h>			// strchr, strcmp, strncmp
+#include "parse_tokens.h"
+#include "faces.h"
+
+#define MAX_CPUS 1024
+#define CPU_MASK_WORDS (MAX_CPUS / (8 * sizeof(unsigned long)))
+#define MAX_LIMITS 16
+
+#ifndef SCHED_BATCH
+#define SCHED_BATCH 3
+#endif
+#ifndef SCHED_IDLE
+#define SCHED_IDLE 5
+#endif
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_NONE 0
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+
+/* "limit cpu=0-3 nice=10 ionice=idle nofile=65536 as=4G -- cmd | cmd2"
+
+   Resource controls applied by each forked child right before exec, so the job
+   doesn't pay a fork+exec for every taskset/nice/ionice wrapper in front of it.
+   The kernel interfaces are called through syscall() (there is no glibc wrapper
+   for ioprio_set, and the raw sched_setaffinity takes a plain bitmask). */
+
+typedef struct Limits
+{
+	unsigned long cpus[CPU_MASK_WORDS];
+	int has_cpus;
+	int nice;
+	int has_nice;
+	int ioprio;				// (class << 13) | level
+	int has_ioprio;
+	struct
+	{
+		int resource;
+		rlim_t value;
+	} rlimits[MAX_LIMITS];
+	int n_rlimits;
+} Limits;
+
+
+static const struct
+{
+	const char* name;
+	int resource;
+	int is_duration;
+} rlimit_names[] =
+{
+	{"as", RLIMIT_AS, 0},
+	{"core", RLIMIT_CORE, 0},
+	{"cputime", RLIMIT_CPU, 1},
+	{"data", RLIMIT_DATA, 0},
+	{"fsize", RLIMIT_FSIZE, 0},
+	{"memlock", RLIMIT_MEMLOCK, 0},
+	{"nofile", RLIMIT_NOFILE, 0},
+	{"nproc", RLIMIT_NPROC, 0},
+	{"stack", RLIMIT_STACK, 0},
+};
+
+
+static void set_cpu (unsigned long* cpus, int cpu)
+{
+	cpus[cpu / (8 * sizeof(unsigned long))] |= 1UL << (cpu % (8 * sizeof(unsigned long)));
+}
+
+/* "0-3,6,8-11" Returns -1 if malformed. */
+int parse_cpu_list (const char* str, unsigned long* cpus)
+{
+	while (*str != 0)
+	{
+		char* end;
+		long first = strtol(str, &end, 10), last = first;
+		if (end == str)
+			return -1;
+
+		if (*end == '-')
+		{
+			str = end + 1;
+			last = strtol(str, &end, 10);
+			if (end == str)
+				return -1;
+		}
+
+		if (first < 0 || last < first || last >= MAX_CPUS)
+			return -1;
+		for (long cpu = first; cpu <= last; cpu++)
+			set_cpu(cpus, cpu);
+
+		if (*end == ',')
+			end++;
+		else if (*end != 0)
+			return -1;
+		str = end;
+	}
+
+	return 0;
+}
+
+/* "idle", "be", "be:4", "rt:0" or just a best-effort level "4". Returns -1 if malformed. */
+static int parse_ioprio (const char* str)
+{
+	int class = IOPRIO_CLASS_BE, level = 4;
+
+	if (strcmp(str, "idle") == 0)
+		return IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+
+	if (strncmp(str, "be", 2) == 0 || strncmp(str, "rt", 2) == 0)
+	{
+		if (str[0] == 'r')
+			class = IOPRIO_CLASS_RT;
+		str += 2;
+		if (*str == 0)
+			return (class << IOPRIO_CLASS_SHIFT) | level;
+		if (*str++ != ':')
+			return -1;
+	}
+
+	char* end;
+	level = strtol(str, &end, 10);
+	if (end == str || *end != 0 || level < 0 || level > 7)
+		return -1;
+
+	return (class << IOPRIO_CLASS_SHIFT) | level;
+}
+
+/* Options: cpu=<list> nice=<n> ionice=<class[:level]> and rlimits
+   as= core= data= fsize= memlock= nofile= nproc= stack= (sizes or "unlimited"), cputime=<duration>.
+   Returns NULL (after printing why) if an option is malformed. */
+Limits* make_Limits (char** options)
+{
+	Limits* l = (Limits*) calloc(1, sizeof(Limits));
+	if (l == NULL)
+	{
+		perror(flip_table " yash: make_Limits: calloc");
+		return NULL;
+	}
+
+	for (; *options != NULL; options++)
+	{
+		char* value = strchr(*options, '=');
+		int ok = 0;
+
+		if (value != NULL)
+		{
+			size_t len = value++ - *options;
+			char* end;
+
+			if (len == 3 && strncmp(*options, "cpu", len) == 0)
+				ok = l->has_cpus = (parse_cpu_list(value, l->cpus) == 0);
+			else if (len == 4 && strncmp(*options, "nice", len) == 0)
+			{
+				l->nice = strtol(value, &end, 10);
+				ok = l->has_nice = (end != value && *end == 0);
+			}
+			else if (len == 6 && strncmp(*options, "ionice", len) == 0)
+				ok = l->has_ioprio = ((l->ioprio = parse_ioprio(value)) != -1);
+			else
+				for (int i=0; i < sizeof(rlimit_names) / sizeof(rlimit_names[0]); i++)
+				{
+					if (strlen(rlimit_names[i].name) != len || strncmp(*options, rlimit_names[i].name, len) != 0)
+						continue;
+
+					long long v;
+					if (strcmp(value, "unlimited") == 0)
+						v = (long long) RLIM_INFINITY;
+					else if (rlimit_names[i].is_duration)
+					{
+						/* Whole seconds, rounded up: "500ms" would be 0, no CPU time at all */
+						long long ms = parse_duration_ms(value);
+						v = (ms < 0) ? -1 : (ms < 1000) ? 1 : (ms + 999) / 1000;
+					}
+					else
+						v = parse_size(value);
+
+					if (v >= 0 && l->n_rlimits < MAX_LIMITS)
+					{
+						l->rlimits[l->n_rlimits].resource = rlimit_names[i].resource;
+						l->rlimits[l->n_rlimits++].value = v;
+						ok = 1;
+					}
+					break;
+				}
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "yash: limit: %s: expected cpu=, nice=, ionice=, as=, core=, cputime=, data=, fsize=, memlock=, nofile=, nproc= or stack=\n", *options);
+			free(l);
+			return NULL;
+		}
+	}
+
+	return l;
+}
+
+/* Called in forked child, right before exec. Returns -1 (after printing why) if a limit can't be applied. */
+int apply_Limits (const Limits* l)
+{
+	if (l == NULL)
+		return 0;
+
+	if (l->has_cpus && syscall(SYS_sched_setaffinity, 0, sizeof(l->cpus), l->cpus) == -1)
+	{
+		perror("yash: limit: sched_setaffinity");
+		return -1;
+	}
+
+	if (l->has_nice && setpriority(PRIO_PROCESS, 0, l->nice) == -1)
+	{
+		perror("yash: limit: setpriority");
+		return -1;
+	}
+
+	if (l->has_ioprio && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, l->ioprio) == -1)
+	{
+		perror("yash: limit: ioprio_set");
+		return -1;
+	}
+
+	for (int i=0; i < l->n_rlimits; i++)
+	{
+		/* Like "ulimit": soft and hard limit alike */
+		struct rlimit r = {l->rlimits[i].value, l->rlimits[i].value};
+		if (setrlimit(l->rlimits[i].resource, &r) == -1)
+		{
+			perror("yash: limit: setrlimit");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Scheduling class of background jobs (set -o bgsched=batch|idle): index into bgsched_choices */
+typedef enum
+{
+	Normal_Sched,
+	Batch_Sched,
+	Idle_Sched
+} Sched_Class;
+
+/* Thread tid (0: the caller). Idle also gets idle I/O priority; Normal resets both.
+   Note that leaving SCHED_IDLE needs CAP_SYS_NICE (or a raised RLIMIT_NICE). */
+int set_Sched_Class (pid_t tid, Sched_Class c)
+{
+	struct sched_param param = {0};
+	int policy = (c == Batch_Sched) ? SCHED_BATCH : (c == Idle_Sched) ? SCHED_IDLE : SCHED_OTHER;
+	int ioprio = ((c == Idle_Sched) ? IOPRIO_CLASS_IDLE : IOPRIO_CLASS_NONE) << IOPRIO_CLASS_SHIFT;
+
+	if (sched_setscheduler(tid, policy, &param) == -1)
+		return -1;
+
+	if (c != Batch_Sched && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, ioprio) == -1)
+		return -1;
+
+	return 0;
+}
+
+
+#endif /* JOB_LIMITS_H */
+
+
+
+/* Test JOB_LIMITS */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <sys/wait.h>		// waitpid
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	char* bad[] = {"cpu=3-1", NULL};
+	printf("cpu=3-1: %s\n", make_Limits(bad) == NULL ? "rejected" : "accepted");
+
+	char* options[] = {"cpu=0", "nice=5", "ionice=idle", "nofile=256", "as=1G", "cputime=1m", NULL};
+	Limits* l = make_Limits(options);
+	if (l == NULL)
+		return 1;
+
+	if (fork() == 0)
+	{
+		if (apply_Limits(l) == -1)
+			_exit(1);
+
+		unsigned long cpus[CPU_MASK_WORDS] = {0};
+		syscall(SYS_sched_getaffinity, 0, sizeof(cpus), cpus);
+
+		struct rlimit nofile, as, cpu;
+		getrlimit(RLIMIT_NOFILE, &nofile);
+		getrlimit(RLIMIT_AS, &as);
+		getrlimit(RLIMIT_CPU, &cpu);
+
+		printf("cpu mask %#lx, nice %d, ioprio class %ld, nofile %llu, as %llu MB, cputime %llu s\n",
+			cpus[0], getpriority(PRIO_PROCESS, 0),
+			syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0) >> IOPRIO_CLASS_SHIFT,
+			(unsigned long long) nofile.rlim_cur, (unsigned long long) as.rlim_cur >> 20,
+			(unsigned long long) cpu.rlim_cur);
+		_exit(0);
+	}
+
+	int status;
+	wait(&status);
+	free(l);
+	return WEXITSTATUS(status);
+}
+#endif
+/* Test JOB_LIMITS */
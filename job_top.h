@@ -0,0 +1,438 @@
+#ifndef JOB_TOP_H
+#define JOB_TOP_H
+
+#include <fcntl.h>			// open, O_RDONLY, O_CLOEXEC
+#include <unistd.h>			// pread, close, sysconf
+#include <dirent.h>			// opendir, readdir
+#include <ctype.h>			// isdigit
+#include <stdio.h>			// printf, fprintf, snprintf
+#include <stdlib.h>			// realloc, qsort, bsearch, free
+#include <string.h>			// strcmp, strrchr
+#include <errno.h>			// EMFILE, ENFILE
+#include <sys/resource.h>	// getrlimit, setrlimit, RLIMIT_NOFILE
+#include "job.h"
+#include "job_control.h"
+#include "events.h"
+#include "relay.h"
+#include "parse_tokens.h"
+
+#define TOP_INTERVAL_MS 1000
+
+
+/* jobs --top [-d interval] [-n count] [-s cpu|read|write|rss]
+
+   Every running job, redrawn in place every interval (until ^C, or count times):
+   CPU%, read and write bytes/s (rchar/wchar: everything through read/write, pipes
+   included) and RSS, summed over every process in the job's pgid, grandchildren too.
+
+   Every process on the system is looked at once: the pid is remembered with its pgid,
+   and for those in a job's pgid /proc/<pid>/stat, io and statm stay open and are
+   re-read with pread. A refresh is then a readdir of /proc plus three preads per
+   job process; only pids not seen before are opened. That is three fds per job
+   process, so the soft RLIMIT_NOFILE is raised to the hard one while this runs; a
+   process whose files still can't be opened is counted as untracked in the header
+   (and tried again at the next refresh) instead of quietly missing from the totals. */
+
+typedef struct Top_Process
+{
+	pid_t pid;
+	pid_t pgid;
+	int stat_fd, io_fd, statm_fd;	// -1 for a process outside every job
+	int sampled;					// cpu, read and written hold a previous sample
+	int seen;						// still in /proc at the last scan
+	int untracked;					// out of fds when it was opened: not in the totals
+	unsigned long long cpu;			// utime + stime, clock ticks
+	long long read, written;		// rchar, wchar
+} Top_Process;
+
+typedef struct Top_Row
+{
+	Job* j;
+	int processes;
+	double cpu;						// ticks since the last refresh
+	long long read, written;		// bytes since the last refresh
+	long long rss;					// bytes
+} Top_Row;
+
+static struct
+{
+	Top_Process* p;					// sorted by pid
+	int n, size;
+} top;
+
+
+static int compare_top_pid (const void* a, const void* b)
+{
+	pid_t x = ((const Top_Process*) a)->pid, y = ((const Top_Process*) b)->pid;
+	return (x > y) - (x < y);
+}
+
+static void close_Top_Process (Top_Process* t)
+{
+	int* fds[3] = {&t->stat_fd, &t->io_fd, &t->statm_fd};
+	for (int i=0; i < 3; i++)
+		if (*fds[i] != -1)
+		{
+			close(*fds[i]);
+			*fds[i] = -1;
+		}
+}
+
+/* "pid (comm) state ppid pgrp ... utime stime": comm may contain anything, so skip to the last ')' */
+static int pread_stat (int fd, pid_t* pgrp, unsigned long long* cpu)
+{
+	char line[512];
+	ssize_t bytes = pread(fd, line, sizeof(line) - 1, 0);
+	if (bytes <= 0)
+		return -1;
+	line[bytes] = 0;
+
+	char* fields = strrchr(line, ')');
+	unsigned long long utime, stime;
+	if (fields == NULL || sscanf(fields, ") %*c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", pgrp, &utime, &stime) != 3)
+		return -1;
+
+	*cpu = utime + stime;
+	return 0;
+}
+
+/* Opens stat, and if the process is in one of the jobs' pgids keeps it with io and statm */
+static void identify_Top_Process (Top_Process* t, Job* jobs)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/stat", t->pid);
+
+	t->pgid = 0;
+	t->sampled = 0;
+	t->untracked = 0;
+	if ((t->stat_fd = open(path, O_RDONLY|O_CLOEXEC)) == -1)
+	{
+		t->untracked = (errno == EMFILE || errno == ENFILE);
+		return;
+	}
+
+	unsigned long long cpu;
+	Job* j = jobs;
+	if (pread_stat(t->stat_fd, &t->pgid, &cpu) == 0)
+		for (; j != NULL && j->pgid != t->pgid; j = j->next)
+			;
+
+	if (j == NULL || !is_Alive(j))
+	{
+		close_Top_Process(t);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/io", t->pid);
+	t->io_fd = open(path, O_RDONLY|O_CLOEXEC);
+	snprintf(path, sizeof(path), "/proc/%d/statm", t->pid);
+	t->statm_fd = open(path, O_RDONLY|O_CLOEXEC);
+
+	if ((t->io_fd == -1 || t->statm_fd == -1) && (errno == EMFILE || errno == ENFILE))
+	{
+		close_Top_Process(t);
+		t->untracked = 1;
+	}
+}
+
+/* Track every pid in /proc, dropping the ones that are gone */
+static void scan_Top ()
+{
+	DIR* proc = opendir("/proc");
+	if (proc == NULL)
+		return;
+
+	for (int i=0; i < top.n; i++)
+		top.p[i].seen = 0;
+
+	int sorted = top.n, added = 0;
+	for (struct dirent* e = readdir(proc); e != NULL; e = readdir(proc))
+	{
+		if (!isdigit((unsigned char) e->d_name[0]))
+			continue;
+
+		Top_Process key = {.pid = atoi(e->d_name)};
+		Top_Process* t = (Top_Process*) bsearch(&key, top.p, sorted, sizeof(Top_Process), compare_top_pid);
+		if (t != NULL)
+		{
+			/* A stage of ours on a pid that belonged to someone else before, or one
+			   there were no fds for: look again */
+			if (t->stat_fd == -1 && (t->untracked || find_Process(t->pid) != NULL))
+				identify_Top_Process(t, current_Job);
+			t->seen = 1;
+			continue;
+		}
+
+		if (top.n == top.size)
+		{
+			int size = top.size ? 2 * top.size : 1024;
+			Top_Process* p = (Top_Process*) realloc(top.p, size * sizeof(Top_Process));
+			if (p == NULL)
+				break;
+			top.p = p;
+			top.size = size;
+		}
+
+		t = &top.p[top.n++];
+		*t = (Top_Process) {.pid = key.pid, .stat_fd = -1, .io_fd = -1, .statm_fd = -1, .seen = 1};
+		identify_Top_Process(t, current_Job);
+		added++;
+	}
+	closedir(proc);
+
+	int n = 0;
+	for (int i=0; i < top.n; i++)
+		if (top.p[i].seen)
+			top.p[n++] = top.p[i];
+		else
+			close_Top_Process(&top.p[i]);
+	top.n = n;
+
+	if (added)
+		qsort(top.p, top.n, sizeof(Top_Process), compare_top_pid);
+}
+
+/* Adds what each job process did since its last sample to its job's row */
+static void sample_Top (Top_Row* rows, int n_rows)
+{
+	long page = sysconf(_SC_PAGESIZE);
+
+	for (int i=0; i < n_rows; i++)
+	{
+		rows[i].processes = 0;
+		rows[i].cpu = rows[i].read = rows[i].written = rows[i].rss = 0;
+	}
+
+	for (int i=0; i < top.n; i++)
+	{
+		Top_Process* t = &top.p[i];
+		if (t->stat_fd == -1)
+			continue;
+
+		Top_Row* row = NULL;
+		for (int r=0; r < n_rows && row == NULL; r++)
+			if (rows[r].j->pgid == t->pgid)
+				row = &rows[r];
+
+		pid_t pgrp;
+		unsigned long long cpu;
+		if (row == NULL || pread_stat(t->stat_fd, &pgrp, &cpu) == -1)
+		{
+			close_Top_Process(t); // exited (or its job did)
+			continue;
+		}
+
+		char buffer[256];
+		long long read = t->read, written = t->written, resident = 0;
+		ssize_t bytes;
+		if (t->io_fd != -1 && (bytes = pread(t->io_fd, buffer, sizeof(buffer) - 1, 0)) > 0)
+		{
+			buffer[bytes] = 0;
+			sscanf(buffer, "rchar: %lld wchar: %lld", &read, &written);
+		}
+		if (t->statm_fd != -1 && (bytes = pread(t->statm_fd, buffer, sizeof(buffer) - 1, 0)) > 0)
+		{
+			buffer[bytes] = 0;
+			sscanf(buffer, "%*d %lld", &resident);
+		}
+
+		/* A process first seen now did all of its work since the last refresh */
+		row->processes++;
+		row->cpu += cpu - (t->sampled ? t->cpu : 0);
+		row->read += read - (t->sampled ? t->read : 0);
+		row->written += written - (t->sampled ? t->written : 0);
+		row->rss += resident * page;
+
+		t->cpu = cpu;
+		t->read = read;
+		t->written = written;
+		t->sampled = 1;
+	}
+}
+
+static void free_Top ()
+{
+	for (int i=0; i < top.n; i++)
+		close_Top_Process(&top.p[i]);
+	free(top.p);
+	top.p = NULL;
+	top.n = top.size = 0;
+}
+
+
+static const char* top_sort_keys[] = {"cpu", "read", "write", "rss", NULL};
+static int top_sort_key = 0;
+
+static int compare_top_row (const void* a, const void* b)
+{
+	const Top_Row* x = (const Top_Row*) a;
+	const Top_Row* y = (const Top_Row*) b;
+	double u, v;
+
+	switch (top_sort_key)
+	{
+		case 1:  u = x->read;    v = y->read;    break;
+		case 2:  u = x->written; v = y->written; break;
+		case 3:  u = x->rss;     v = y->rss;     break;
+		default: u = x->cpu;     v = y->cpu;     break;
+	}
+
+	if (u != v)
+		return (u < v) ? 1 : -1; // biggest first
+	return x->j->index - y->j->index;
+}
+
+static void print_Top (Top_Row* rows, int n_rows, double elapsed, long long scan_ns)
+{
+	long ticks = sysconf(_SC_CLK_TCK);
+
+	qsort(rows, n_rows, sizeof(Top_Row), compare_top_row);
+
+	int untracked = 0;
+	for (int i=0; i < top.n; i++)
+		untracked += top.p[i].untracked;
+
+	printf("\033[H\033[J");
+	printf("jobs --top: %d jobs, %d processes tracked", n_rows, top.n);
+	if (untracked > 0)
+		printf(" (%d of them untracked: out of fds)", untracked);
+	printf(", refreshed in %.2fms, sorted by %s (^C to stop)\n\n", scan_ns / 1e6, top_sort_keys[top_sort_key]);
+	printf("  %4s %7s %5s %6s %11s %11s %7s  %s\n", "job", "pgid", "procs", "cpu%", "read", "write", "rss", "command");
+
+	for (int i=0; i < n_rows; i++)
+	{
+		Top_Row* r = &rows[i];
+		char read[16], written[16], rss[24];
+		printf("  %4d %7d %5d %5.0f%% %11s %11s %7s  %s\n", r->j->index, r->j->pgid, r->processes,
+			100.0 * r->cpu / ticks / elapsed, format_rate(r->read / elapsed, read, sizeof(read)),
+			format_rate(r->written / elapsed, written, sizeof(written)), format_kb(r->rss / 1024, rss, sizeof(rss)),
+			r->j->command);
+	}
+	fflush(stdout);
+}
+
+/* Returns -1 on a usage error */
+int top_Jobs (char** args)
+{
+	long long interval_ms = TOP_INTERVAL_MS;
+	int count = -1;
+	top_sort_key = 0;
+
+	for (; *args != NULL; args++)
+	{
+		if (strcmp(*args, "-d") == 0 && args[1] != NULL)
+			interval_ms = parse_duration_ms(*++args);
+		else if (strcmp(*args, "-n") == 0 && args[1] != NULL)
+			count = atoi(*++args);
+		else if (strcmp(*args, "-s") == 0 && args[1] != NULL)
+		{
+			args++;
+			for (top_sort_key = 0; top_sort_keys[top_sort_key] != NULL; top_sort_key++)
+				if (strcmp(top_sort_keys[top_sort_key], *args) == 0)
+					break;
+			if (top_sort_keys[top_sort_key] == NULL)
+				return -1;
+		}
+		else
+			return -1;
+	}
+
+	if (interval_ms <= 0 || count == 0)
+		return -1;
+
+
+	/* Three fds per job process: as many as allowed, until this returns (jobs launched
+	   later don't inherit it) */
+	struct rlimit saved_nofile, nofile;
+	int raised = getrlimit(RLIMIT_NOFILE, &saved_nofile) == 0 && saved_nofile.rlim_cur < saved_nofile.rlim_max;
+	if (raised)
+	{
+		nofile = saved_nofile;
+		nofile.rlim_cur = nofile.rlim_max;
+		raised = setrlimit(RLIMIT_NOFILE, &nofile) == 0;
+	}
+
+	/* The first scan opens everything; it only primes the samples */
+	update_Jobs();
+	Top_Row rows[count_Jobs(current_Job)+1];
+	int n_rows = 0;
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		if (is_Alive(j) && j->pgid > 0)
+			rows[n_rows++] = (Top_Row) {.j = j};
+
+	scan_Top();
+	sample_Top(rows, n_rows);
+
+	long long last = get_monotonic_ns(), next = last;
+	interrupted = 0;
+	watch_Children();
+
+	for (int shown = 0; !interrupted && (count < 0 || shown < count); shown++)
+	{
+		next += interval_ms * 1000000;
+		long long wait_ms;
+		while (!interrupted && (wait_ms = (next - get_monotonic_ns()) / 1000000) > 0)
+			wait_Events(wait_ms, -1);
+		if (interrupted)
+			break;
+
+		/* Jobs that ended since drop out (the job table itself is left alone until the prompt) */
+		int alive = 0;
+		for (int i=0; i < n_rows; i++)
+			if (is_Alive(rows[i].j))
+				rows[alive++] = rows[i];
+		n_rows = alive;
+
+		long long start = get_monotonic_ns();
+		scan_Top();
+		sample_Top(rows, n_rows);
+		long long now = get_monotonic_ns();
+
+		print_Top(rows, n_rows, (now - last) / 1e9, now - start);
+		last = now;
+
+		if (n_rows == 0)
+			break;
+	}
+
+	free_Top();
+	if (raised)
+		setrlimit(RLIMIT_NOFILE, &saved_nofile);
+	return 0;
+}
+
+
+#endif /* JOB_TOP_H */
+
+
+
+/* Test JOB_TOP */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <signal.h>			// kill
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	/* A busy job and an idle one: "yes" has to come out on top */
+	const char* commands[] = {"sleep 5", "yes | cat > /dev/null"};
+	for (int i=0; i < 2; i++)
+	{
+		strcpy(input_buffer, commands[i]);
+		Job* j = make_Job(set_tokens(" \t"));
+		j->foreground = 0;
+		j->next = current_Job;
+		current_Job = j;
+		launch_Job(j);
+	}
+
+	char* args[] = {"-d", "500ms", "-n", "2", NULL};
+	top_Jobs(args);
+
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		kill(- j->pgid, SIGTERM);
+	return 0;
+}
+#endif
+/* Test JOB_TOP */
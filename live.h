@@ -0,0 +1,259 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+
+#include <sys/mman.h>		// shm_open, shm_unlink, mmap, munmap
+#include <sys/stat.h>		// fstat
+#include <fcntl.h>			// O_CREAT, O_RDWR, O_CLOEXEC
+#include <unistd.h>			// ftruncate, close
+#include <stdio.h>			// snprintf
+#include <string.h>			// memcpy, memset
+
+#define LIVE_MAGIC 0x6c687379	// "yshl"
+#define LIVE_VERSION 1
+#define LIVE_MAX_JOBS 64
+#define LIVE_MAX_STATS 8
+#define LIVE_COMMAND_SIZE 64
+#define LIVE_READ_RETRIES 1000
+#define LIVE_INTERVAL_MS 1000		// how often the shell publishes
+
+
+/* set -o live: a POSIX shared-memory segment, /dev/shm/yash.<pid>, where the shell
+   publishes its counters, latency percentiles and a snapshot of the job table for
+   external monitors (yash_top.c). The shell only writes memory: no syscalls, no I/O
+   on the monitors' behalf, and they never block it.
+
+   Consistency is a seqlock: the shell makes seq odd, writes, then makes it even again.
+   A reader copies the whole segment out and keeps the copy only if seq was the same
+   even number before and after. This header is the layout and the two sides of the
+   lock, shared by the shell and its readers. */
+
+typedef struct Live_Job
+{
+	int index;
+	pid_t pgid;
+	char state[12];
+	int foreground;
+	int stages;
+	double cpu_s;				// user + system, every stage
+	long long rss_kb;			// resident now (peak once reaped), every stage
+	double runtime_s;
+	char command[LIVE_COMMAND_SIZE];	// truncated
+} Live_Job;
+
+typedef struct Live_Stat
+{
+	char name[16];
+	unsigned long long count;
+	unsigned long long sum_ns;
+	unsigned long long p50_ns, p90_ns, p99_ns, max_ns;
+} Live_Stat;
+
+typedef struct Live_Segment
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long seq;		// odd while the shell is writing
+
+	pid_t shell_pid;
+	long long updated_ns;		// CLOCK_MONOTONIC of the last publish
+	double shell_cpu_s;
+
+	unsigned long long jobs_launched;
+	unsigned long long jobs_finished;
+	unsigned long long processes_forked;
+	unsigned long long processes_reaped;
+
+	int n_stats;
+	Live_Stat stats[LIVE_MAX_STATS];
+
+	int n_jobs;					// may be fewer than the shell has: the newest LIVE_MAX_JOBS
+	Live_Job jobs[LIVE_MAX_JOBS];
+} Live_Segment;
+
+
+static void get_live_name (pid_t pid, char* name, size_t size)
+{
+	snprintf(name, size, "/yash.%d", pid);
+}
+
+
+/* Shell side */
+
+/* Returns NULL (after printing why) if the segment can't be created */
+Live_Segment* create_Live (pid_t pid)
+{
+	char name[32];
+	get_live_name(pid, name, sizeof(name));
+
+	int fd = shm_open(name, O_CREAT|O_RDWR|O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		perror("yash: live: shm_open");
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(Live_Segment)) == -1)
+	{
+		perror("yash: live: ftruncate");
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	void* segment = mmap(NULL, sizeof(Live_Segment), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED)
+	{
+		perror("yash: live: mmap");
+		shm_unlink(name);
+		return NULL;
+	}
+
+	Live_Segment* l = (Live_Segment*) segment;
+	memset(l, 0, sizeof(*l));
+	l->version = LIVE_VERSION;
+	l->shell_pid = pid;
+	__atomic_store_n(&l->magic, LIVE_MAGIC, __ATOMIC_RELEASE);
+	return l;
+}
+
+void remove_Live (Live_Segment* l)
+{
+	if (l == NULL)
+		return;
+
+	char name[32];
+	get_live_name(l->shell_pid, name, sizeof(name));
+	munmap(l, sizeof(Live_Segment));
+	shm_unlink(name);
+}
+
+static inline void begin_Live_write (Live_Segment* l)
+{
+	__atomic_store_n(&l->seq, l->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void end_Live_write (Live_Segment* l)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&l->seq, l->seq + 1, __ATOMIC_RELAXED);
+}
+
+
+/* Reader side */
+
+/* Map a shell's segment read-only. Returns NULL if there is none (or it isn't one). */
+const Live_Segment* open_Live (pid_t pid)
+{
+	char name[32];
+	get_live_name(pid, name, sizeof(name));
+
+	int fd = shm_open(name, O_RDONLY|O_CLOEXEC, 0);
+	if (fd == -1)
+		return NULL;
+
+	struct stat st;
+	void* segment = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(Live_Segment))
+		segment = mmap(NULL, sizeof(Live_Segment), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (segment == MAP_FAILED)
+		return NULL;
+
+	const Live_Segment* l = (const Live_Segment*) segment;
+	if (__atomic_load_n(&l->magic, __ATOMIC_ACQUIRE) != LIVE_MAGIC || l->version != LIVE_VERSION)
+	{
+		munmap(segment, sizeof(Live_Segment));
+		return NULL;
+	}
+
+	return l;
+}
+
+void close_Live (const Live_Segment* l)
+{
+	munmap((void*) l, sizeof(Live_Segment));
+}
+
+/* A consistent copy. Returns -1 if the shell kept writing through every retry. */
+int read_Live (const Live_Segment* l, Live_Segment* copy)
+{
+	for (int i=0; i < LIVE_READ_RETRIES; i++)
+	{
+		unsigned long long before = __atomic_load_n(&l->seq, __ATOMIC_ACQUIRE);
+		if (before & 1)
+			continue;
+
+		memcpy(copy, (const void*) l, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&l->seq, __ATOMIC_RELAXED) == before)
+			return 0;
+	}
+
+	return -1;
+}
+
+
+#endif /* LIVE_H */
+
+
+
+/* Test LIVE */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <sys/wait.h>		// waitpid
+
+/* A writer hammering the segment against a reader: no torn copy may get through */
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	Live_Segment* l = create_Live(getpid());
+	if (l == NULL)
+		return 1;
+
+	pid_t reader = fork();
+	if (reader == 0)
+	{
+		const Live_Segment* shared = open_Live(getppid());
+		Live_Segment copy;
+		int torn = 0, reads = 0, busy = 0;
+
+		for (int i=0; i < 200000; i++)
+		{
+			if (read_Live(shared, &copy) == -1)
+			{
+				busy++;
+				continue;
+			}
+			reads++;
+			for (int j=0; j < LIVE_MAX_JOBS; j++)
+				torn += (copy.jobs[j].index != (int) copy.jobs_launched);
+		}
+
+		printf("%d consistent reads, %d torn, %d gave up\n", reads, torn, busy);
+		_exit(torn != 0);
+	}
+
+	for (int n=1; n < 2000000; n++)
+	{
+		begin_Live_write(l);
+		l->jobs_launched = n;
+		for (int j=0; j < LIVE_MAX_JOBS; j++)
+			l->jobs[j].index = n;
+		end_Live_write(l);
+	}
+
+	int status;
+	waitpid(reader, &status, 0);
+	remove_Live(l);
+
+	printf("segment removed: %s\n", open_Live(getpid()) == NULL ? "yes" : "no");
+	return WEXITSTATUS(status);
+}
+#endif
+/* Test LIVE */
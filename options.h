@@ -0,0 +1,195 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>			// printf, fprintf
+#include <string.h>			// strcmp, strchr, strdup
+#include <stdlib.h>			// free
+#include "trace.h"
+#include "parse_tokens.h"
+
+#define SLOW_DEFAULT_MS 10000
+
+
+/* Shell options: "set -o name", "set +o name", and "set -o" to list them. */
+
+int placement_option = 0;	// topology-aware CPU placement of jobs (topology.h)
+int bgsched_option = 0;		// scheduling class of background jobs: index into bgsched_choices
+int supervisor_option = 0;	// background pipelines are forked by a job leader (job.h)
+int meter_option = 0;		// status line with the rates of a foreground job's "|>" pipes (relay.h)
+int live_option = 0;		// counters and job table in shared memory for yash-top (live.h)
+int slow_option = 0;		// one-line report of jobs that ran for slow_ms or longer (job_control.h)
+char* slow_text = NULL;		// "set -o slow=duration"
+long long slow_ms = SLOW_DEFAULT_MS;
+
+static const char* bgsched_choices[] = {"off", "batch", "idle", NULL};
+
+
+/* set -o slow[=duration]: keeps the last duration given, SLOW_DEFAULT_MS until one is */
+static void slow_changed ()
+{
+	static char* kept = NULL;
+	if (kept != slow_text)
+		free(kept);
+	kept = slow_text;
+
+	long long ms = (slow_text != NULL) ? parse_duration_ms(slow_text) : SLOW_DEFAULT_MS;
+	if (ms < 0)
+	{
+		fprintf(stderr, "yash: set: slow=%s: invalid duration\n", slow_text);
+		free(slow_text);
+		kept = slow_text = NULL;
+		slow_option = 0;
+		return;
+	}
+
+	slow_ms = ms;
+}
+
+
+typedef struct Option
+{
+	const char* name;
+	int* value;
+	const char** choices;	// "name=choice", or NULL for an on/off flag
+	char** text;			// "name=anything" is kept here (a flag otherwise), or NULL
+	void (*changed) ();		// called after every set, or NULL
+} Option;
+
+static Option option_list[] =
+{
+	{"placement", &placement_option, NULL, NULL, NULL},
+	{"bgsched", &bgsched_option, bgsched_choices, NULL, NULL},
+	{"supervisor", &supervisor_option, NULL, NULL, NULL},
+	{"meter", &meter_option, NULL, NULL, NULL},
+	{"live", &live_option, NULL, NULL, NULL},
+	{"slow", &slow_option, NULL, &slow_text, slow_changed},
+	{"trace", &trace_option, NULL, &trace_path, trace_changed},
+};
+
+#define OPTION_COUNT (int) (sizeof(option_list) / sizeof(option_list[0]))
+
+
+static Option* find_Option (const char* name)
+{
+	for (int i=0; i < OPTION_COUNT; i++)
+		if (strcmp(option_list[i].name, name) == 0)
+			return &option_list[i];
+
+	return NULL;
+}
+
+void print_Options ()
+{
+	for (int i=0; i < OPTION_COUNT; i++)
+	{
+		Option* o = &option_list[i];
+		if (o->choices != NULL)
+			printf("set -o %s=%s\n", o->name, o->choices[*o->value]);
+		else if (o->text != NULL && *o->value && *o->text != NULL)
+			printf("set -o %s=%s\n", o->name, *o->text);
+		else
+			printf("set %co %s\n", *o->value ? '-' : '+', o->name);
+	}
+}
+
+/* "-o name" turns a flag on (or picks the first real choice), "+o name" turns it off
+   (choice 0), "-o name=choice" picks a choice, "-o name=text" sets a text option
+   and turns it on. Returns -1 if malformed. */
+static int set_Option (char* name, int on)
+{
+	char* value = strchr(name, '=');
+	if (value != NULL)
+		*value++ = 0;
+
+	Option* o = find_Option(name);
+	if (o == NULL)
+	{
+		fprintf(stderr, "yash: set: %s: no such option\n", name);
+		return -1;
+	}
+
+	if (value == NULL)
+	{
+		*o->value = on;
+		if (o->changed != NULL)
+			o->changed();
+		return 0;
+	}
+
+	if (on && o->text != NULL)
+	{
+		*o->text = strdup(value);
+		*o->value = 1;
+		if (o->changed != NULL)
+			o->changed();
+		return 0;
+	}
+
+	for (int i=0; on && o->choices != NULL && o->choices[i] != NULL; i++)
+		if (strcmp(o->choices[i], value) == 0)
+		{
+			*o->value = i;
+			if (o->changed != NULL)
+				o->changed();
+			return 0;
+		}
+
+	fprintf(stderr, "yash: set: %s=%s: invalid value\n", name, value);
+	return -1;
+}
+
+/* set [-o name[=value] | +o name]...
+   Returns -1 on a usage error */
+int set_builtin (char** args)
+{
+	if (args[0] == NULL)
+	{
+		print_Options();
+		return 0;
+	}
+
+	for (; *args != NULL; args++)
+	{
+		int on = (strcmp(*args, "-o") == 0);
+		if (!on && strcmp(*args, "+o") != 0)
+			return -1;
+
+		if (args[1] == NULL)
+		{
+			print_Options();
+			return 0;
+		}
+
+		if (set_Option(*++args, on) == -1)
+			return 0;
+	}
+
+	return 0;
+}
+
+
+#endif /* OPTIONS_H */
+
+
+
+/* Test OPTIONS */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+
+int main(int argc, char* argv[])
+{
+	char value[] = "bgsched=idle";
+	char* on[] = {"-o", "placement", "-o", value, NULL};
+	set_builtin(on);
+	print_Options();
+
+	char* off[] = {"+o", "placement", "+o", "bgsched", "-o", "nonsense", NULL};
+	set_builtin(off);
+	print_Options();
+
+	char* bad[] = {"-x", NULL};
+	printf("set -x: %d\n", set_builtin(bad));
+
+	return 0;
+}
+#endif
+/* Test OPTIONS */
@@ -0,0 +1,396 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>			// getline, fopen, printf, fwrite
+#include <stdlib.h>			// malloc, realloc, free, atoi
+#include <string.h>			// strcmp, strstr, strdup
+#include <unistd.h>			// pipe2, read, close, sysconf
+#include <fcntl.h>			// open, O_CLOEXEC, O_NONBLOCK, fcntl
+#include <signal.h>			// kill, SIGTERM, SIGCONT
+#include "job.h"
+#include "job_control.h"
+#include "events.h"
+#include "faces.h"
+
+
+/* parallel [-j slots] [-n batch] [-k] [--tag] [-a file] cmd ... [{}] [::: item ...]
+
+   Runs cmd once per item (or per batch of items), in at most "slots" concurrent jobs.
+   "{}" in cmd is replaced by the item(s); without it the items are appended.
+   Items come from ::: arguments, from -a file, or else one per line on stdin.
+   Each run is a normal background Job (make_Job/launch_Job). The next run is launched
+   from the SIGCHLD event that frees a slot, so there's no polling.
+   With -k (keep order) or --tag (prefix lines with the item), each run's stdout is
+   collected through a pipe and printed as a whole once the run completes. */
+
+typedef struct Run
+{
+	int first, count;		// items[first .. first+count)
+	Job* j;
+	int out_fd;				// read end of the captured stdout, or -1
+	char* output;
+	size_t length, capacity;
+	int done;
+} Run;
+
+
+static void on_Run_output (int fd, short revents, void* data)
+{
+	Run* r = (Run*) data;
+	char buffer[4096];
+	ssize_t bytes = read(fd, buffer, sizeof(buffer));
+
+	if (bytes > 0)
+	{
+		if (r->length + bytes > r->capacity)
+		{
+			r->capacity = 2 * (r->length + bytes);
+			r->output = (char*) realloc(r->output, r->capacity);
+		}
+		memcpy(r->output + r->length, buffer, bytes);
+		r->length += bytes;
+	}
+	else if (bytes == 0 || (errno != EAGAIN && errno != EINTR))
+	{
+		remove_Event(fd);
+		close(fd);
+		r->out_fd = -1;
+	}
+}
+
+/* Substitute the run's items into the command template.
+   Strings allocated here are recorded in owned[] for the caller to free. */
+static char** expand_template (char** template, char** items, int count, char** owned, int* n_owned)
+{
+	int N = count_tokens(template), n_braces = 0;
+	for (int i=0; i < N; i++)
+		n_braces += strcmp(template[i], "{}") == 0;
+
+	/* Every standalone {} takes count slots, and the items are appended if there is none */
+	char** tokens = (char**) malloc((N + n_braces * count + count + 1) * sizeof(char*));
+	char* joined = concat_tokens(items, " ");
+	int n = 0, substituted = 0;
+
+	owned[(*n_owned)++] = joined;
+
+	for (int i=0; i < N; i++)
+	{
+		char* at = strstr(template[i], "{}");
+
+		if (strcmp(template[i], "{}") == 0)
+		{
+			for (int k=0; k < count; k++)
+				tokens[n++] = items[k];
+		}
+		else if (at != NULL)
+		{
+			size_t prefix = at - template[i];
+			char* str = (char*) malloc(strlen(template[i]) + strlen(joined) + 1);
+			sprintf(str, "%.*s%s%s", (int) prefix, template[i], joined, at + 2);
+			tokens[n++] = owned[(*n_owned)++] = str;
+		}
+		else
+		{
+			tokens[n++] = template[i];
+			continue;
+		}
+
+		substituted = 1;
+	}
+
+	if (!substituted)
+		for (int k=0; k < count; k++)
+			tokens[n++] = items[k];
+
+	tokens[n] = NULL;
+	return tokens;
+}
+
+static int start_Run (Run* r, char** template, char** items, int capture)
+{
+	char* owned[MAX_TOKENS];
+	int n_owned = 0;
+
+	char* batch[r->count + 1];
+	for (int k=0; k < r->count; k++)
+		batch[k] = items[r->first + k];
+	batch[r->count] = NULL;
+
+	char** tokens = expand_template(template, batch, r->count, owned, &n_owned);
+	r->j = make_Job(tokens);
+
+	free(tokens);
+	for (int i=0; i < n_owned; i++)
+		free(owned[i]);
+
+	if (r->j == NULL)
+		return -1;
+
+	r->j->foreground = 0;
+	r->j->next = current_Job;
+	current_Job = r->j;
+
+	/* Not the terminal: a run in the background reading it would stop (SIGTTIN) and be waited for forever */
+	Process* first = r->j->p;
+	if (first->in == -1 && (first->in = open("/dev/null", O_RDONLY | O_CLOEXEC)) != -1)
+		first->close_me[0] = 1;
+
+	/* Capture stdout of the last stage (unless it is redirected) */
+	Process* last = r->j->p;
+	while (last->next != NULL)
+		last = last->next;
+
+	int fds[2] = {-1, -1};
+	if (capture && last->out == -1 && pipe2(fds, O_CLOEXEC) == 0)
+	{
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+		last->out = fds[1];
+	}
+
+	if (launch_Job(r->j) == -1)
+	{
+		/* Failed, and its slot free again: left in the job table to be reaped and reported */
+		abort_Launch(r->j);
+		r->j = NULL;
+		if (fds[1] != -1)
+		{
+			close(fds[0]);
+			close(fds[1]);
+			last->out = -1;
+		}
+		return -1;
+	}
+
+	if (fds[1] != -1)
+	{
+		close(fds[1]); // the child has its copy
+		last->out = -1;
+		r->out_fd = fds[0];
+		add_Event(r->out_fd, POLLIN, on_Run_output, r);
+	}
+
+	return 0;
+}
+
+static void print_Run (Run* r, char** items, int tag)
+{
+	if (!tag)
+	{
+		fwrite(r->output, 1, r->length, stdout);
+		return;
+	}
+
+	for (size_t start = 0; start < r->length; )
+	{
+		char* end = memchr(r->output + start, '\n', r->length - start);
+		size_t len = (end != NULL) ? (size_t) (end - (r->output + start)) : r->length - start;
+
+		printf("%s", items[r->first]);
+		for (int k=1; k < r->count; k++)
+			printf(" %s", items[r->first + k]);
+		printf("\t%.*s\n", (int) len, r->output + start);
+
+		start += len + 1;
+	}
+}
+
+/* Returns -1 on a usage error */
+int parallel (char** args)
+{
+	int slots = sysconf(_SC_NPROCESSORS_ONLN);
+	int batch = 1;
+	int keep_order = 0;
+	int tag = 0;
+	char* item_file = NULL;
+
+	for (; *args != NULL && args[0][0] == '-'; args++)
+	{
+		if (strcmp(*args, "-j") == 0 && args[1] != NULL)
+			slots = atoi(*++args);
+		else if (strcmp(*args, "-n") == 0 && args[1] != NULL)
+			batch = atoi(*++args);
+		else if (strcmp(*args, "-k") == 0)
+			keep_order = 1;
+		else if (strcmp(*args, "--tag") == 0)
+			tag = 1;
+		else if (strcmp(*args, "-a") == 0 && args[1] != NULL)
+			item_file = *++args;
+		else if (strcmp(*args, "--") == 0)
+		{
+			args++;
+			break;
+		}
+		else
+			return -1;
+	}
+
+	if (slots <= 0)
+		slots = sysconf(_SC_NPROCESSORS_ONLN);
+	if (batch <= 0)
+		batch = 1;
+
+
+	/* Split command template from ::: items */
+	char** template = args;
+	int separator = get_token_index(args, ":::");
+	if (no_tokens(template) || separator == 0)
+		return -1;
+
+
+	/* Collect items (own copies: input_buffer is reused by make_Job's callers) */
+	int n_items = 0, capacity = 64;
+	char** items = (char**) malloc(capacity * sizeof(char*));
+
+	if (separator != -1)
+	{
+		args[separator] = NULL;
+		for (char** a = &args[separator+1]; *a != NULL; a++)
+		{
+			items[n_items++] = strdup(*a);
+			if (n_items == capacity)
+				items = (char**) realloc(items, (capacity *= 2) * sizeof(char*));
+		}
+	}
+	else
+	{
+		FILE* f = (item_file != NULL) ? fopen(item_file, "re") : stdin;
+		if (f == NULL)
+		{
+			fprintf(stderr, "yash: parallel: ");
+			perror(item_file);
+			free(items);
+			return 0;
+		}
+
+		char* line = NULL;
+		size_t size = 0;
+		ssize_t length;
+		while ((length = getline(&line, &size, f)) != -1)
+		{
+			if (length > 0 && line[length-1] == '\n')
+				line[--length] = 0;
+			if (length == 0)
+				continue;
+
+			items[n_items++] = strdup(line);
+			if (n_items == capacity)
+				items = (char**) realloc(items, (capacity *= 2) * sizeof(char*));
+		}
+		free(line);
+
+		if (f != stdin)
+			fclose(f);
+		else
+			clearerr(stdin); // ^D ended the item list, not the shell
+	}
+	items[n_items] = NULL;
+
+	template = copy_tokens(template);
+
+
+	/* Dispatch */
+	int n_runs = (n_items + batch - 1) / batch;
+	Run* runs = (Run*) calloc(n_runs + 1, sizeof(Run));
+	int capture = keep_order || tag;
+	int next = 0, running = 0, printed = 0;
+
+	interrupted = 0;
+	watch_Children();
+
+	while (1)
+	{
+		/* Completed runs: reaped and output fully read */
+		for (int i = printed; i < next; i++)
+		{
+			Run* r = &runs[i];
+			if (r->done || is_Alive(r->j) || r->out_fd != -1)
+				continue;
+
+			r->done = 1;
+			running--;
+			remove_Job(r->j);
+			r->j = NULL;
+
+			if (!keep_order && capture)
+				print_Run(r, items, tag);
+		}
+
+		/* In order: print completed runs until the first unfinished one */
+		while (printed < next && runs[printed].done)
+		{
+			if (keep_order)
+				print_Run(&runs[printed], items, tag);
+			free(runs[printed].output);
+			printed++;
+		}
+
+		if (printed == n_runs || (interrupted && running == 0))
+			break;
+
+		/* Refill free slots */
+		while (running < slots && next < n_runs && !interrupted)
+		{
+			Run* r = &runs[next++];
+			r->first = (next-1) * batch;
+			r->count = (r->first + batch <= n_items) ? batch : n_items - r->first;
+			r->out_fd = -1;
+
+			if (start_Run(r, template, items, capture) == -1)
+				r->done = 1;
+			else
+				running++;
+		}
+
+		if (running == 0)
+			continue;
+
+		if (wait_Events(-1, -1) == -1 && errno == EINTR && interrupted)
+			for (int i = printed; i < next; i++)
+				if (runs[i].j != NULL)
+				{
+					kill(- runs[i].j->pgid, SIGTERM);
+					kill(- runs[i].j->pgid, SIGCONT); // a stopped run only gets it once continued
+				}
+	}
+
+	fflush(stdout);
+	for (int i=0; i < n_items; i++)
+		free(items[i]);
+	free(items);
+	free(template);
+	free(runs);
+
+	return 0;
+}
+
+
+#endif /* PARALLEL_H */
+
+
+
+/* Test PARALLEL */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	char* line[] = {"-j", "3", "-k", "--tag", "echo", "item", "{}", ":::", "1", "2", "3", "4", "5", "6", "7", NULL};
+
+	long long start = get_monotonic_ns();
+	parallel(line);
+	printf("took %lld ms, %d jobs left\n", (get_monotonic_ns() - start) / 1000000, count_Jobs(current_Job));
+
+	char* braces[] = {"-n", "3", "echo", "{}", "{}", "{}", ":::", "a", "b", "c", NULL};
+	parallel(braces); // a b c a b c a b c
+
+	char* sleeps[] = {"-j", "4", "sleep", ":::", "0.2", "0.2", "0.2", "0.2", "0.2", "0.2", "0.2", "0.2", NULL};
+	start = get_monotonic_ns();
+	parallel(sleeps);
+	printf("8 x sleep 0.2 in 4 slots took %lld ms (expected ~400)\n", (get_monotonic_ns() - start) / 1000000);
+
+	return 0;
+}
+#endif
+/* Test PARALLEL */
@@ -1,127 +1,232 @@
-#ifndef PARSE_TOKENS_H
-#define PARSE_TOKENS_H
-#include <string.h>
-#include "tokenize.h"
-
-
-int get_token_index (char** tokens, const char* key)
-{
-	if (tokens == NULL)
-		return -1;
-
-	for (int i=0; tokens[i] != NULL; i++)
-		if (strcmp(key, tokens[i]) == 0)
-			return i;
-
-	return -1;
-}
-
-char* get_token_after (char** tokens, const char* key)
-{
-	int index = get_token_index(tokens, key);
-
-	if (index == -1)
-		return NULL;
-	else
-		return tokens[index+1];
-}
-
-int first_of_tokens_index (char** tokens, const char** keys)
-{
-	if (tokens == NULL)
-		return -1;
-
-	for (int i=0; tokens[i] != NULL; i++)
-		for (int j=0; keys[j] != NULL; j++)
-			if (strcmp(keys[j], tokens[i]) == 0)
-				return i;
-
-	return -1;
-}
-
-char** set_pipe_start (char** tokens)
-{
-	int index = get_token_index(tokens, "|");
-
-	if (index == -1)
-		return NULL;
-	else
-	{
-		tokens[index] = NULL;
-		return &tokens[index+1];
-	}
-}
-
-char* get_redirect_in (char** tokens)
-{
-	return get_token_after(tokens, "<");
-}
-
-char* get_redirect_out (char** tokens)
-{
-	return get_token_after(tokens, ">");
-}
-
-char* get_redirect_error (char** tokens)
-{
-	return get_token_after(tokens, "2>");
-}
-
-int clear_ampersand (char** tokens)
-{
-	int index = get_token_index(tokens, "&");
-
-	if (index != -1)
-		tokens[index] = NULL;
-
-	return index != -1;
-}
-
-int set_args_end (char** tokens)
-{
-	static const char* special[] = {"<", ">", "2>", "&"};
-	int index = first_of_tokens_index(tokens, special);
-
-	if (index != -1)
-		tokens[index] = NULL;
-
-	return index;
-}
-
-#endif /* PARSE_TOKENS_H */
-
-
-
-/* Test PARSE_TOKENS */
-#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
-#include <stdio.h>
-
-int main(int argc, char* argv[])
-{
-	if (argc == 1)
-		freopen("parse_tokens_input.txt", "r", stdin);
-
-	for (int i=0; read_line(stdin) != NULL; i++) {
-		printf("\n%d\n",i);
-		char** tokens = set_tokens(" \t");
-		char** child_tokens = set_pipe_start(tokens);
-
-		printf("in: '%s'\n", get_redirect_in(tokens));
-		printf("out: '%s'\n", get_redirect_out(tokens));
-		printf("error: %s\n", get_redirect_error(tokens));
-		printf("cleared ampersand: %d\n", clear_ampersand(tokens) ? 1 : 0);
-		printf("args end: %d\n", set_args_end(tokens));
-
-		if (child_tokens != NULL) {
-			// printf("child_tokens: \n");
-			// print_tokens(child_tokens);
-			printf("child in: '%s'\n", get_redirect_in(child_tokens));
-			printf("child out: '%s'\n", get_redirect_out(child_tokens));
-			printf("child error: %s\n", get_redirect_error(child_tokens));
-			printf("cleared ampersand: %d\n", clear_ampersand(child_tokens) ? 1 : 0);
-			printf("args end: %d\n", set_args_end(child_tokens));
-		}
-	}
-}
-#endif
+#ifndef PARSE_TOKENS_H
+#define PARSE_TOKENS_H
+#include <string.h>
+#include <stdlib.h>			// strtoll, strtod
+#include <errno.h>			// errno, ERANGE
+#include <limits.h>			// LLONG_MAX
+#include "tokenize.h"
+
+
+int get_token_index (char** tokens, const char* key)
+{
+	if (tokens == NULL)
+		return -1;
+
+	for (int i=0; tokens[i] != NULL; i++)
+		if (strcmp(key, tokens[i]) == 0)
+			return i;
+
+	return -1;
+}
+
+char* get_token_after (char** tokens, const char* key)
+{
+	int index = get_token_index(tokens, key);
+
+	if (index == -1)
+		return NULL;
+	else
+		return tokens[index+1];
+}
+
+int first_of_tokens_index (char** tokens, const char** keys)
+{
+	if (tokens == NULL)
+		return -1;
+
+	for (int i=0; tokens[i] != NULL; i++)
+		for (int j=0; keys[j] != NULL; j++)
+			if (strcmp(keys[j], tokens[i]) == 0)
+				return i;
+
+	return -1;
+}
+
+static const char* pipe_symbols[] = {"|", "|>", NULL};
+
+/* "a | b" or "a |> b" (relayed by the shell: relay.h) */
+char** set_pipe_start (char** tokens)
+{
+	int index = first_of_tokens_index(tokens, pipe_symbols);
+
+	if (index == -1)
+		return NULL;
+	else
+	{
+		tokens[index] = NULL;
+		return &tokens[index+1];
+	}
+}
+
+/* Whether the pipe set_pipe_start would split tokens at is a "|>" */
+int is_relayed_pipe (char** tokens)
+{
+	int index = first_of_tokens_index(tokens, pipe_symbols);
+
+	return index != -1 && strcmp(tokens[index], "|>") == 0;
+}
+
+char* get_redirect_in (char** tokens)
+{
+	return get_token_after(tokens, "<");
+}
+
+char* get_redirect_out (char** tokens)
+{
+	return get_token_after(tokens, ">");
+}
+
+char* get_redirect_error (char** tokens)
+{
+	return get_token_after(tokens, "2>");
+}
+
+int clear_ampersand (char** tokens)
+{
+	int index = get_token_index(tokens, "&");
+
+	if (index != -1)
+		tokens[index] = NULL;
+
+	return index != -1;
+}
+
+int set_args_end (char** tokens)
+{
+	static const char* special[] = {"<", ">", "2>", "&", NULL};
+	int index = first_of_tokens_index(tokens, special);
+
+	if (index != -1)
+		tokens[index] = NULL;
+
+	return index;
+}
+
+/* "cmd &! key=value ..." becomes "cmd &". Returns the key=value list (or NULL). */
+char** set_watchdog_start (char** tokens)
+{
+	int index = get_token_index(tokens, "&!");
+
+	if (index == -1)
+		return NULL;
+
+	tokens[index] = "&";
+	return &tokens[index+1];
+}
+
+/* "limit key=value ... -- cmd" becomes "limit key=value ...". Returns cmd
+   (empty if "--" is missing), or tokens itself if they aren't limit-prefixed. */
+char** set_limit_start (char** tokens)
+{
+	if (no_tokens(tokens) || strcmp(tokens[0], "limit") != 0)
+		return tokens;
+
+	int index = get_token_index(tokens, "--");
+
+	if (index == -1)
+		return &tokens[count_tokens(tokens)];
+
+	tokens[index] = NULL;
+	return &tokens[index+1];
+}
+
+/* "time [-j] cmd": returns how many tokens the prefix takes (0 if there is none).
+   *json is set if -j (JSON output) was given. */
+int get_time_prefix (char** tokens, int* json)
+{
+	*json = 0;
+	if (no_tokens(tokens) || strcmp(tokens[0], "time") != 0)
+		return 0;
+
+	if (tokens[1] != NULL && strcmp(tokens[1], "-j") == 0)
+	{
+		*json = 1;
+		return 2;
+	}
+
+	return 1;
+}
+
+/* "4096", "64K", "2G" -> bytes. Returns -1 if malformed, or too big for a long long. */
+long long parse_size (const char* str)
+{
+	char* end;
+	errno = 0;
+	long long size = strtoll(str, &end, 10);
+
+	if (end == str || size < 0 || errno == ERANGE)
+		return -1;
+
+	int shift = 0;
+	switch (*end)
+	{
+		case 'k': case 'K': shift = 10; end++; break;
+		case 'm': case 'M': shift = 20; end++; break;
+		case 'g': case 'G': shift = 30; end++; break;
+		case 't': case 'T': shift = 40; end++; break;
+	}
+
+	if (size > (LLONG_MAX >> shift))
+		return -1;
+
+	return (*end == 0) ? size << shift : -1;
+}
+
+/* "250ms", "30s", "5m", "1h" (default unit: seconds) -> milliseconds. Returns -1 if malformed. */
+long long parse_duration_ms (const char* str)
+{
+	char* end;
+	double value = strtod(str, &end);
+
+	if (end == str || value < 0)
+		return -1;
+
+	if (strcmp(end, "ms") == 0)
+		return value;
+	if (*end == 0 || strcmp(end, "s") == 0)
+		return value * 1000;
+	if (strcmp(end, "m") == 0)
+		return value * 60 * 1000;
+	if (strcmp(end, "h") == 0)
+		return value * 3600 * 1000;
+
+	return -1;
+}
+
+#endif /* PARSE_TOKENS_H */
+
+
+
+/* Test PARSE_TOKENS */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>
+
+int main(int argc, char* argv[])
+{
+	if (argc == 1)
+		freopen("parse_tokens_input.txt", "r", stdin);
+
+	for (int i=0; read_line(stdin) != NULL; i++) {
+		printf("\n%d\n",i);
+		char** tokens = set_tokens(" \t");
+		char** child_tokens = set_pipe_start(tokens);
+
+		printf("in: '%s'\n", get_redirect_in(tokens));
+		printf("out: '%s'\n", get_redirect_out(tokens));
+		printf("error: %s\n", get_redirect_error(tokens));
+		printf("cleared ampersand: %d\n", clear_ampersand(tokens) ? 1 : 0);
+		printf("args end: %d\n", set_args_end(tokens));
+
+		if (child_tokens != NULL) {
+			// printf("child_tokens: \n");
+			// print_tokens(child_tokens);
+			printf("child in: '%s'\n", get_redirect_in(child_tokens));
+			printf("child out: '%s'\n", get_redirect_out(child_tokens));
+			printf("child error: %s\n", get_redirect_error(child_tokens));
+			printf("cleared ampersand: %d\n", clear_ampersand(child_tokens) ? 1 : 0);
+			printf("args end: %d\n", set_args_end(child_tokens));
+		}
+	}
+}
+#endif
 /* Test PARSE_TOKENS */
\ No newline at end of file
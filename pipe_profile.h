@@ -0,0 +1,249 @@
+#ifndef PIPE_PROFILE_H
+#define PIPE_PROFILE_H
+
+#include <sys/ioctl.h>		// ioctl, FIONREAD
+#include <sys/stat.h>		// fstat, S_ISFIFO
+#include <fcntl.h>			// open, fcntl, O_NONBLOCK, O_CLOEXEC
+#include <stdio.h>			// printf, fprintf
+#include <stdlib.h>			// calloc, free
+#include <string.h>			// strcmp
+#include <unistd.h>			// close, sysconf
+#include "job.h"
+#include "job_control.h"
+#include "events.h"
+#include "parse_tokens.h"
+
+#ifndef F_GETPIPE_SZ
+#define F_GETPIPE_SZ 1032
+#endif
+
+#define PROFILE_INTERVAL_MS 100
+#define PROFILE_DURATION_MS 3000
+
+
+/* jobs --profile [%job] [-i interval] [-t duration]
+
+   Samples a running pipeline: the fill level of every inter-stage pipe (FIONREAD on
+   the pipe itself, reopened through /proc/<reader>/fd/0 and kept open while sampling)
+   and every stage's CPU time and bytes read (/proc/<pid>/stat and io).
+   The bottleneck is the stage that keeps its input pipe full and its output pipe empty:
+   the one with the largest (input fill - output fill), where the first stage counts as
+   having a full input and the last one an empty output. */
+
+typedef struct Stage_Profile
+{
+	Process* p;
+	int in_fd;					// the pipe into this stage, or -1
+	int capacity;				// of that pipe, bytes
+	double in_fill;				// sum of fill fractions over samples
+	unsigned long long cpu_start, cpu_end;	// clock ticks
+	long long read_start, read_end;			// rchar
+} Stage_Profile;
+
+
+static int open_stage_input (Process* p, int* capacity)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/fd/0", p->pid);
+
+	int fd = open(path, O_RDONLY|O_NONBLOCK|O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISFIFO(st.st_mode))
+	{
+		close(fd);
+		return -1;
+	}
+
+	*capacity = fcntl(fd, F_GETPIPE_SZ);
+	if (*capacity <= 0)
+		*capacity = 65536;
+
+	return fd;
+}
+
+static int sample_Stages (Stage_Profile* stages, int n)
+{
+	int alive = 0;
+
+	for (int i=0; i < n; i++)
+	{
+		Stage_Profile* s = &stages[i];
+		unsigned long long utime, stime;
+		if (read_proc_times(s->p->pid, &utime, &stime) == 0)
+		{
+			s->cpu_end = utime + stime;
+			s->read_end = read_proc_value(s->p->pid, "io", "rchar: ");
+			alive++;
+		}
+
+		/* A stage that was just forked may not have its pipe on stdin yet */
+		if (i > 0 && s->in_fd == -1 && s->p->pid > 0)
+			s->in_fd = open_stage_input(s->p, &s->capacity);
+
+		int bytes = 0;
+		if (s->in_fd != -1 && ioctl(s->in_fd, FIONREAD, &bytes) == 0)
+			s->in_fill += (double) bytes / s->capacity;
+	}
+
+	return alive;
+}
+
+/* Returns -1 on a usage error */
+int profile_Job (char** args)
+{
+	Job* j = current_Job;
+	long long interval_ms = PROFILE_INTERVAL_MS, duration_ms = PROFILE_DURATION_MS;
+
+	for (; *args != NULL; args++)
+	{
+		if (args[0][0] == '%')
+		{
+			if ((j = find_Job_spec(*args)) == NULL)
+			{
+				fprintf(stderr, "yash: jobs: %s: no such job\n", *args);
+				return 0;
+			}
+		}
+		else if (strcmp(*args, "-i") == 0 && args[1] != NULL)
+			interval_ms = parse_duration_ms(*++args);
+		else if (strcmp(*args, "-t") == 0 && args[1] != NULL)
+			duration_ms = parse_duration_ms(*++args);
+		else
+			return -1;
+	}
+
+	if (interval_ms <= 0 || duration_ms <= 0)
+		return -1;
+
+	update_Jobs();
+	if (j == NULL || !is_Alive(j))
+	{
+		fprintf(stderr, "yash: jobs: --profile: no running job\n");
+		return 0;
+	}
+
+
+	/* One entry per stage: its input pipe is the edge from the previous stage */
+	int n = 0;
+	for (Process* p = j->p; p != NULL; p = p->next)
+		n++;
+
+	Stage_Profile* stages = (Stage_Profile*) calloc(n, sizeof(Stage_Profile));
+	int i = 0;
+	for (Process* p = j->p; p != NULL; p = p->next, i++)
+	{
+		stages[i].p = p;
+		stages[i].in_fd = -1;
+	}
+
+	sample_Stages(stages, n);
+	for (i=0; i < n; i++)
+	{
+		stages[i].in_fill = 0;
+		stages[i].cpu_start = stages[i].cpu_end;
+		stages[i].read_start = stages[i].read_end;
+	}
+
+
+	/* Sample until the duration is up, the job is over, or ^C */
+	long long start = get_monotonic_ns(), next = start;
+	int samples = 0;
+	interrupted = 0;
+	watch_Children();
+
+	while (!interrupted && (get_monotonic_ns() - start) / 1000000 < duration_ms)
+	{
+		next += interval_ms * 1000000;
+		long long wait_ms;
+		while (!interrupted && (wait_ms = (next - get_monotonic_ns()) / 1000000) > 0)
+			wait_Events(wait_ms, -1);
+
+		if (sample_Stages(stages, n) == 0)
+			break;
+		samples++;
+	}
+	double elapsed = (get_monotonic_ns() - start) / 1e9;
+
+
+	/* Report */
+	printf("[%d] %s: %d samples over %.1fs\n", j->index, j->command, samples, elapsed);
+	printf("  %-24s %6s %8s %9s %11s\n", "stage", "cpu%", "in-pipe", "out-pipe", "in-rate");
+
+	int bottleneck = -1;
+	double worst = -2;
+	long ticks = sysconf(_SC_CLK_TCK);
+	for (i=0; i < n; i++)
+	{
+		Stage_Profile* s = &stages[i];
+		double in = (s->in_fd != -1 && samples) ? s->in_fill / samples : -1;
+		double out = (i+1 < n && stages[i+1].in_fd != -1 && samples) ? stages[i+1].in_fill / samples : -1;
+
+		char in_str[16] = "-", out_str[16] = "-", rate[16] = "-";
+		if (in >= 0)
+			snprintf(in_str, sizeof(in_str), "%.0f%%", 100 * in);
+		if (out >= 0)
+			snprintf(out_str, sizeof(out_str), "%.0f%%", 100 * out);
+		if (i > 0)
+			format_rate((s->read_end - s->read_start) / elapsed, rate, sizeof(rate));
+
+		char* command = concat_tokens(s->p->argv, " ");
+		printf("  %-24.24s %5.0f%% %8s %9s %11s\n", command,
+			100.0 * (s->cpu_end - s->cpu_start) / ticks / elapsed, in_str, out_str, rate);
+		free(command);
+
+		double score = (in >= 0 ? in : 1) - (out >= 0 ? out : 0);
+		if (score > worst)
+		{
+			worst = score;
+			bottleneck = i;
+		}
+	}
+
+	if (bottleneck != -1 && samples > 0 && n > 1)
+	{
+		char* command = concat_tokens(stages[bottleneck].p->argv, " ");
+		printf("bottleneck: %s\n", command);
+		free(command);
+	}
+
+	for (i=0; i < n; i++)
+		if (stages[i].in_fd != -1)
+			close(stages[i].in_fd);
+	free(stages);
+
+	return 0;
+}
+
+
+#endif /* PIPE_PROFILE_H */
+
+
+
+/* Test PIPE_PROFILE */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <signal.h>			// kill
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	/* gzip can't keep up with cat: its input pipe stays full, its output pipe empty */
+	strcpy(input_buffer, "cat /dev/zero | gzip -6 | cat > /dev/null");
+	Job* j = make_Job(set_tokens(" \t"));
+	j->foreground = 0;
+	j->next = current_Job;
+	current_Job = j;
+	launch_Job(j);
+
+	char* args[] = {"%1", "-t", "1s", NULL};
+	profile_Job(args);
+
+	kill(- j->pgid, SIGTERM);
+	return 0;
+}
+#endif
+/* Test PIPE_PROFILE */
@@ -0,0 +1,219 @@
+#ifndef PTY_H
+#define PTY_H
+
+#include <stdlib.h>			// posix_openpt, grantpt, unlockpt, ptsname, _exit
+#include <stdio.h>			// perror
+#include <string.h>			// memmem, memmove, strlen
+#include <fcntl.h>			// open, O_RDWR
+#include <unistd.h>			// fork, setsid, dup2, execv, write, read, tcgetpgrp
+#include <poll.h>			// poll
+#include <signal.h>			// kill, SIGKILL
+#include <errno.h>			// EINTR
+#include <sys/ioctl.h>		// TIOCSCTTY
+#include <sys/wait.h>		// waitpid
+#include "events.h"
+
+#define PTY_BUFFER_SIZE 65536
+
+
+/* A program on a pseudo-terminal, typed at like a user would: yash needs a tty (it
+   takes the terminal's foreground group and restores its modes at every prompt), so
+   this is how the tests and the latency harness drive it. The program runs in a
+   session of its own with the pty as its controlling terminal, so ^C and ^Z typed
+   into it reach whatever group yash gave the terminal to. */
+
+typedef struct Pty
+{
+	int fd;					// master side
+	pid_t pid;
+	char buffer[PTY_BUFFER_SIZE];	// output not yet matched by expect_Pty
+	size_t len;
+} Pty;
+
+
+/* Returns -1 (after printing why) if the program couldn't be started */
+int open_Pty (Pty* t, char* const argv[])
+{
+	t->len = 0;
+	t->fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (t->fd == -1 || grantpt(t->fd) == -1 || unlockpt(t->fd) == -1)
+	{
+		perror("pty: posix_openpt");
+		return -1;
+	}
+	const char* name = ptsname(t->fd);
+
+	t->pid = fork();
+	if (t->pid == -1)
+	{
+		perror("pty: fork");
+		close(t->fd);
+		return -1;
+	}
+
+	if (t->pid == 0)
+	{
+		close(t->fd);
+		setsid();
+		int slave = open(name, O_RDWR);
+		if (slave == -1 || ioctl(slave, TIOCSCTTY, 0) == -1)
+		{
+			perror("pty: slave");
+			_exit(127);
+		}
+		dup2(slave, STDIN_FILENO);
+		dup2(slave, STDOUT_FILENO);
+		dup2(slave, STDERR_FILENO);
+		if (slave > STDERR_FILENO)
+			close(slave);
+
+		/* A session leader can't move to a group of its own (as yash does): like a
+		   job-control shell, this one stays behind and runs the program in the
+		   terminal's foreground group */
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			setpgid(0, 0);
+			signal(SIGTTOU, SIG_IGN);
+			tcsetpgrp(STDIN_FILENO, getpid());
+			signal(SIGTTOU, SIG_DFL);
+
+			execv(argv[0], argv);
+			perror(argv[0]);
+			_exit(127);
+		}
+
+		int status;
+		while (pid > 0 && waitpid(pid, &status, 0) == -1 && errno == EINTR)
+			;
+		if (pid == -1 || !WIFSIGNALED(status))
+			_exit(pid == -1 ? 127 : WEXITSTATUS(status));
+		signal(WTERMSIG(status), SIG_DFL);
+		kill(getpid(), WTERMSIG(status));
+		_exit(128 + WTERMSIG(status));
+	}
+
+	return 0;
+}
+
+/* Keystrokes, as typed: "\n" is Enter, "\003" ^C, "\032" ^Z */
+int send_Pty (Pty* t, const char* keys)
+{
+	size_t len = strlen(keys);
+	return (write(t->fd, keys, len) == (ssize_t) len) ? 0 : -1;
+}
+
+/* Waits until the terminal's foreground group is no longer pgid (the program
+   handed it to a job). Returns the new one, or -1 after timeout_ms. */
+pid_t wait_Foreground_Pty (Pty* t, pid_t pgid, int timeout_ms)
+{
+	long long deadline = get_monotonic_ns() + timeout_ms * 1000000LL;
+	pid_t now;
+	while ((now = tcgetpgrp(t->fd)) == pgid)
+	{
+		if (get_monotonic_ns() > deadline)
+			return -1;
+		usleep(100);
+	}
+	return now;
+}
+
+/* Reads until text shows up in the output (everything up to and including it is
+   consumed). Returns when it did (CLOCK_MONOTONIC ns), or -1 after timeout_ms or if
+   the program is gone. */
+long long expect_Pty (Pty* t, const char* text, int timeout_ms)
+{
+	size_t text_len = strlen(text);
+	long long deadline = get_monotonic_ns() + timeout_ms * 1000000LL;
+
+	for (;;)
+	{
+		char* match = memmem(t->buffer, t->len, text, text_len);
+		if (match != NULL)
+		{
+			long long now = get_monotonic_ns();
+			size_t used = match - t->buffer + text_len;
+			memmove(t->buffer, t->buffer + used, t->len - used);
+			t->len -= used;
+			return now;
+		}
+
+		/* Full without a match: keep the tail, the text may be starting there */
+		if (t->len == sizeof(t->buffer))
+		{
+			memmove(t->buffer, t->buffer + t->len - text_len, text_len);
+			t->len = text_len;
+		}
+
+		long long left = (deadline - get_monotonic_ns()) / 1000000;
+		if (left <= 0)
+			return -1;
+
+		struct pollfd fds = {t->fd, POLLIN, 0};
+		int ready = poll(&fds, 1, left);
+		if (ready == -1 && errno == EINTR)
+			continue;
+		if (ready <= 0)
+			return -1;
+
+		ssize_t bytes = read(t->fd, t->buffer + t->len, sizeof(t->buffer) - t->len);
+		if (bytes <= 0) // EIO: the slave side is closed
+			return -1;
+		t->len += bytes;
+	}
+}
+
+/* Returns the program's wait status (it is killed if it doesn't exit within timeout_ms) */
+int close_Pty (Pty* t, int timeout_ms)
+{
+	int status = 0;
+	long long deadline = get_monotonic_ns() + timeout_ms * 1000000LL;
+
+	/* Drain: a program blocked writing to a full pty never gets to exit */
+	char drain[4096];
+	while (waitpid(t->pid, &status, WNOHANG) == 0)
+	{
+		if (get_monotonic_ns() > deadline)
+		{
+			kill(t->pid, SIGKILL);
+			waitpid(t->pid, &status, 0);
+			break;
+		}
+		struct pollfd fds = {t->fd, POLLIN, 0};
+		if (poll(&fds, 1, 10) == 1 && read(t->fd, drain, sizeof(drain)) <= 0)
+			usleep(10000);
+	}
+
+	close(t->fd);
+	return status;
+}
+
+
+#endif /* PTY_H */
+
+
+
+/* Test PTY */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+
+int main(int argc, char* argv[])
+{
+	static Pty t;
+	char* argv_cat[] = {"/bin/cat", NULL};
+	if (open_Pty(&t, argv_cat) == -1)
+		return 1;
+
+	long long start = get_monotonic_ns();
+	send_Pty(&t, "hello\n");
+	long long echoed = expect_Pty(&t, "hello", 1000);
+	long long output = expect_Pty(&t, "hello", 1000);
+	printf("echo: %s, cat: %s (%.0fus)\n", echoed != -1 ? "yes" : "no", output != -1 ? "yes" : "no", (output - start) / 1e3);
+
+	send_Pty(&t, "\003");
+	int status = close_Pty(&t, 1000);
+	printf("^C: %s\n", WIFSIGNALED(status) && WTERMSIG(status) == SIGINT ? "SIGINT" : "not killed");
+	return 0;
+}
+#endif
+/* Test PTY */
@@ -0,0 +1,239 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <sys/timerfd.h>	// timerfd_create, timerfd_settime
+#include <stdio.h>			// fopen, fscanf, printf
+#include <stdlib.h>			// atoi, atof
+#include <string.h>			// strcmp, strchr
+#include <unistd.h>			// sysconf
+#include "job.h"
+#include "events.h"
+#include "faces.h"
+
+#define QUEUE_RETRY_MS 1000
+
+
+/* Background jobs started with "queue cmd ..." wait in the job table as Queued
+   and are launched, oldest first, whenever fewer than queue_max of them are running
+   and (if thresholds are set) Linux PSI shows the box isn't under pressure. */
+
+static const char* pressure_names[] = {"cpu", "memory", "io"};
+static double pressure_limit[3] = {0, 0, 0};	// "some avg10" percentages (0: ignore)
+static int queue_max = 0;						// 0: number of online cpus
+static int queue_retry_fd = -1;
+
+
+static int get_queue_max ()
+{
+	if (queue_max <= 0)
+		queue_max = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return queue_max;
+}
+
+/* "some avg10=1.23 avg60=..." Returns -1 if unavailable. */
+static double read_pressure (const char* resource)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/pressure/%s", resource);
+
+	FILE* f = fopen(path, "re");
+	if (f == NULL)
+		return -1;
+
+	double avg10 = -1;
+	if (fscanf(f, "some avg10=%lf", &avg10) != 1)
+		avg10 = -1;
+
+	fclose(f);
+	return avg10;
+}
+
+static int is_under_pressure ()
+{
+	for (int i=0; i < 3; i++)
+		if (pressure_limit[i] > 0 && read_pressure(pressure_names[i]) > pressure_limit[i])
+			return 1;
+
+	return 0;
+}
+
+static void on_queue_retry (int fd, short revents, void* data);
+
+/* Try again later: nothing else would wake the queue if it is only pressure holding it back */
+static void retry_Queue ()
+{
+	if (queue_retry_fd == -1)
+	{
+		queue_retry_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (queue_retry_fd == -1)
+		{
+			perror(blank_face " yash: queue: timerfd_create");
+			return;
+		}
+		add_Event(queue_retry_fd, POLLIN, on_queue_retry, NULL);
+	}
+
+	struct itimerspec t = {{0, 0}, {QUEUE_RETRY_MS / 1000, (QUEUE_RETRY_MS % 1000) * 1000000}};
+	timerfd_settime(queue_retry_fd, 0, &t, NULL);
+}
+
+/* Launch queued jobs while there are free slots. Called whenever a child is reaped. */
+void dispatch_Queue ()
+{
+	int running = 0;
+	Job* oldest = NULL;
+
+	for (Job* j = current_Job; j != NULL; j = j->next)
+	{
+		if (j->state == Queued_State)
+			oldest = j;
+		else if (j->queued && is_Alive(j))
+			running++;
+	}
+
+	while (oldest != NULL && running < get_queue_max())
+	{
+		if (is_under_pressure())
+		{
+			retry_Queue();
+			return;
+		}
+
+		mark_Job(oldest, Running_State);
+		if (launch_Job(oldest) == -1)
+		{
+			/* Never ran: its slot goes to the next one */
+			abort_Launch(oldest);
+			oldest->state = Error_State;
+		}
+		else
+			running++;
+
+		/* Next oldest queued job is the closest Queued one before it in the list */
+		Job* next = NULL;
+		for (Job* j = current_Job; j != oldest; j = j->next)
+			if (j->state == Queued_State)
+				next = j;
+		oldest = next;
+	}
+}
+
+static void on_queue_retry (int fd, short revents, void* data)
+{
+	unsigned long long expirations;
+	read(fd, &expirations, sizeof(expirations));
+
+	dispatch_Queue();
+}
+
+/* Job is already in the job table */
+void enqueue_Job (Job* j)
+{
+	j->foreground = 0;
+	j->queued = 1;
+	mark_Job(j, Queued_State);
+
+	dispatch_Queue();
+}
+
+/* queue [-j max] [-p cpu=N,memory=N,io=N | -p off]	configure (or show) the queue
+   queue cmd ...									queue cmd as a background job */
+static char** queue_options (char** args)
+{
+	for (; *args != NULL && args[0][0] == '-'; args++)
+	{
+		if (strcmp(*args, "-j") == 0 && args[1] != NULL)
+			queue_max = atoi(*++args);
+		else if (strcmp(*args, "-p") == 0 && args[1] != NULL)
+		{
+			char* option = *++args;
+			if (strcmp(option, "off") == 0)
+			{
+				for (int i=0; i < 3; i++)
+					pressure_limit[i] = 0;
+				continue;
+			}
+
+			for (option = strtok(option, ","); option != NULL; option = strtok(NULL, ","))
+			{
+				char* value = strchr(option, '=');
+				int i = 0;
+				if (value != NULL)
+					for (*value++ = 0; i < 3 && strcmp(option, pressure_names[i]) != 0; i++)
+						;
+
+				if (value == NULL || i == 3)
+					fprintf(stderr, "yash: queue: %s: expected cpu=, memory= or io=\n", option);
+				else
+					pressure_limit[i] = atof(value);
+			}
+		}
+		else if (strcmp(*args, "--") == 0)
+			return args+1;
+		else
+		{
+			fprintf(stderr, "yash: queue: usage: queue [-j max] [-p cpu=N,memory=N,io=N | -p off] [cmd ...]\n");
+			return NULL;
+		}
+	}
+
+	return args;
+}
+
+void print_Queue ()
+{
+	int queued = 0;
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		if (j->state == Queued_State)
+			queued++;
+
+	printf("max %d, %d queued", get_queue_max(), queued);
+	for (int i=0; i < 3; i++)
+		if (pressure_limit[i] > 0)
+			printf(", %s pressure < %g%% (now %g%%)", pressure_names[i], pressure_limit[i], read_pressure(pressure_names[i]));
+	printf("\n");
+}
+
+
+#endif /* QUEUE_H */
+
+
+
+/* Test QUEUE */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <sys/wait.h>		// waitpid
+
+int main(int argc, char* argv[])
+{
+	queue_max = 2;
+
+	for (int i=0; i < 5; i++)
+	{
+		strcpy(input_buffer, "sleep 0.2");
+		Job* j = make_Job(set_tokens(" \t"));
+		j->next = current_Job;
+		current_Job = j;
+		enqueue_Job(j);
+	}
+
+	long long start = get_monotonic_ns();
+	pid_t pid;
+	int status;
+	while ((pid = waitpid(WAIT_ANY, &status, 0)) > 0)
+	{
+		for (Job* j = current_Job; j != NULL; j = j->next)
+			for (Process* p = j->p; p != NULL; p = p->next)
+				if (p->pid == pid)
+					p->state = Done_State;
+		dispatch_Queue();
+	}
+
+	/* 5 jobs, 2 at a time: 3 rounds */
+	printf("took %lld ms (expected ~600)\n", (get_monotonic_ns() - start) / 1000000);
+	print_Queue();
+	return 0;
+}
+#endif
+/* Test QUEUE */
@@ -0,0 +1,373 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <fcntl.h>			// splice, pipe2, fcntl, O_NONBLOCK
+#include <sys/ioctl.h>		// ioctl, FIONREAD
+#include <sys/timerfd.h>	// timerfd_create, timerfd_settime
+#include <unistd.h>			// close, read, tcgetpgrp
+#include <stdio.h>			// fprintf, snprintf
+#include <stdlib.h>			// calloc, free
+#include <errno.h>			// EAGAIN, EINTR
+#include "events.h"
+#include "faces.h"
+
+#define RELAY_PIPE_SIZE (1 << 20)
+#define RELAY_CHUNK RELAY_PIPE_SIZE		// bytes per splice (capped by the pipe's capacity)
+#define RELAY_BURST 16					// splices per wakeup, so one busy edge can't starve the loop
+#define RELAY_SAMPLE_NS 100000000LL		// rate sampling period
+#define RELAY_SMOOTH_NS 1000000000LL	// rate smoothing time constant
+#define METER_INTERVAL_MS 500
+
+
+/* "a |> b": a pipe the shell relays itself. "a" writes into one pipe, "b" reads from
+   another, and the shell moves the data between them with splice(2) from its event loop:
+   pipe to pipe, so the pages are moved, not copied. On the way it counts bytes and keeps
+   a smoothed rate, shown by "jobs -l" and (set -o meter) on a status line.
+   The relay ends the way a pipe would: EOF upstream closes the downstream pipe, and a
+   downstream reader that went away closes the upstream one (the writer gets EPIPE). */
+
+typedef struct Relay
+{
+	int in;					// read end of the upstream pipe, or -1 once finished
+	int out;				// write end of the downstream pipe, or -1 once finished
+	int waiting_fd;			// whichever of the two is registered with the event loop
+	long long bytes;
+	long long start_ns, end_ns;
+	long long sample_ns;
+	long long sample_bytes;
+	double rate;			// bytes/s
+	struct Meter* meter;	// status line it is shown on, or NULL
+} Relay;
+
+/* set -o meter: the rates of a foreground job's relayed edges on stderr, redrawn in
+   place while the job owns the terminal and finished with a newline when the last
+   of its edges closes. */
+typedef struct Meter
+{
+	int fd;					// timerfd, or -1 once finished
+	int index;				// job number
+	pid_t pgid;
+	int shown;				// the line has been drawn
+	Relay** relays;
+	int n;
+} Meter;
+
+
+Relay* make_Relay ()
+{
+	Relay* r = (Relay*) calloc(1, sizeof(Relay));
+	if (r == NULL)
+	{
+		perror(flip_table " yash: make_Relay: calloc");
+		return NULL;
+	}
+
+	r->in = r->out = r->waiting_fd = -1;
+	return r;
+}
+
+const char* format_rate (double bytes_per_s, char* buffer, size_t size)
+{
+	if (bytes_per_s >= 1 << 20)
+		snprintf(buffer, size, "%.1fMB/s", bytes_per_s / (1 << 20));
+	else if (bytes_per_s >= 1 << 10)
+		snprintf(buffer, size, "%.1fKB/s", bytes_per_s / (1 << 10));
+	else
+		snprintf(buffer, size, "%.0fB/s", bytes_per_s);
+	return buffer;
+}
+
+const char* format_bytes (long long bytes, char* buffer, size_t size)
+{
+	if (bytes >= 1LL << 30)
+		snprintf(buffer, size, "%.1fG", bytes / (double) (1LL << 30));
+	else if (bytes >= 1 << 20)
+		snprintf(buffer, size, "%.1fM", bytes / (double) (1 << 20));
+	else if (bytes >= 1 << 10)
+		snprintf(buffer, size, "%.1fK", bytes / (double) (1 << 10));
+	else
+		snprintf(buffer, size, "%lldB", bytes);
+	return buffer;
+}
+
+/* Exponentially smoothed over RELAY_SMOOTH_NS, resampled at most every RELAY_SAMPLE_NS.
+   Once the relay is finished: its average. */
+double get_Relay_rate (Relay* r)
+{
+	long long now = get_monotonic_ns(), elapsed = now - r->sample_ns;
+
+	if (elapsed >= RELAY_SAMPLE_NS)
+	{
+		double rate = (r->bytes - r->sample_bytes) * 1e9 / elapsed;
+		r->rate += (rate - r->rate) * elapsed / (elapsed + RELAY_SMOOTH_NS);
+		r->sample_ns = now;
+		r->sample_bytes = r->bytes;
+	}
+
+	if (r->in == -1)
+		return (r->end_ns > r->start_ns) ? r->bytes * 1e9 / (r->end_ns - r->start_ns) : 0;
+
+	return r->rate;
+}
+
+
+static void finish_Meter (Meter* m);
+
+static void finish_Relay (Relay* r)
+{
+	if (r->in == -1)
+		return;
+
+	int in = r->in, out = r->out;
+	remove_Event(r->waiting_fd);
+	r->in = r->out = r->waiting_fd = -1;
+	r->end_ns = get_monotonic_ns();
+
+	/* Last edge of the status line: finish it before the next stage sees EOF and prints */
+	int live = 0;
+	for (int i=0; r->meter != NULL && i < r->meter->n; i++)
+		live += (r->meter->relays[i]->in != -1);
+	if (r->meter != NULL && live == 0)
+		finish_Meter(r->meter);
+
+	close(in);
+	close(out);
+}
+
+static void on_Relay (int fd, short revents, void* data);
+
+static void wait_Relay (Relay* r, int fd)
+{
+	if (r->waiting_fd == fd)
+		return;
+
+	remove_Event(r->waiting_fd);
+	r->waiting_fd = fd;
+	if (add_Event(fd, (fd == r->in) ? POLLIN : POLLOUT, on_Relay, r) == -1)
+		finish_Relay(r);
+}
+
+static void on_Relay (int fd, short revents, void* data)
+{
+	Relay* r = (Relay*) data;
+
+	for (int i=0; i < RELAY_BURST; i++)
+	{
+		ssize_t bytes = splice(r->in, NULL, r->out, NULL, RELAY_CHUNK, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+		if (bytes > 0)
+			r->bytes += bytes;
+		else if (bytes == 0)
+		{
+			finish_Relay(r); // EOF upstream
+			return;
+		}
+		else if (errno == EAGAIN)
+		{
+			/* Either nothing to move or no room for it: wait on the side that is stuck */
+			int pending = 0;
+			ioctl(r->in, FIONREAD, &pending);
+			wait_Relay(r, (pending > 0) ? r->out : r->in);
+			break;
+		}
+		else if (errno != EINTR)
+		{
+			finish_Relay(r); // EPIPE: nobody reads downstream anymore
+			return;
+		}
+	}
+
+	get_Relay_rate(r);
+}
+
+/* upstream: read end of the pipe the previous stage writes to (the relay takes it over).
+   Returns the read end of the pipe for the next stage, or -1 on error. */
+int start_Relay (Relay* r, int upstream)
+{
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == -1)
+	{
+		perror(flip_table " yash: pipe");
+		return -1;
+	}
+
+	/* Only the shell's ends: the stages keep blocking pipes */
+	fcntl(upstream, F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	/* Bigger pipes, fewer wakeups per byte (best effort: fs.pipe-max-size caps it) */
+	fcntl(upstream, F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+	fcntl(fds[1], F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+
+	r->in = upstream;
+	r->out = fds[1];
+	r->start_ns = r->sample_ns = get_monotonic_ns();
+
+	if (add_Event(r->in, POLLIN, on_Relay, r) == -1)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		r->in = r->out = -1;
+		return -1;
+	}
+	r->waiting_fd = r->in;
+
+	return fds[0];
+}
+
+void destroy_Relay (Relay* r)
+{
+	if (r == NULL)
+		return;
+
+	r->meter = NULL;
+	finish_Relay(r);
+	free(r);
+}
+
+
+static void print_Meter (Meter* m)
+{
+	fprintf(stderr, "\r[%d]", m->index);
+	for (int i=0; i < m->n; i++)
+	{
+		char bytes[16], rate[16];
+		fprintf(stderr, "  |> %s %s", format_bytes(m->relays[i]->bytes, bytes, sizeof(bytes)),
+			format_rate(get_Relay_rate(m->relays[i]), rate, sizeof(rate)));
+	}
+	fprintf(stderr, "\033[K");
+	m->shown = 1;
+}
+
+static void on_Meter_tick (int fd, short revents, void* data)
+{
+	Meter* m = (Meter*) data;
+
+	unsigned long long expirations;
+	if (read(fd, &expirations, sizeof(expirations)) == -1)
+		return;
+
+	/* Only while the job is in the foreground: not over the prompt */
+	if (tcgetpgrp(STDERR_FILENO) == m->pgid)
+		print_Meter(m);
+}
+
+static void finish_Meter (Meter* m)
+{
+	if (m->fd == -1)
+		return;
+
+	remove_Event(m->fd);
+	close(m->fd);
+	m->fd = -1;
+
+	if (m->shown)
+	{
+		print_Meter(m);
+		fprintf(stderr, "\n");
+	}
+}
+
+/* Returns NULL if the status line can't be set up (the relays run on regardless) */
+Meter* start_Meter (int index, pid_t pgid, Relay** relays, int n)
+{
+	Meter* m = (Meter*) calloc(1, sizeof(Meter));
+	if (m == NULL)
+		return NULL;
+
+	m->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+	m->index = index;
+	m->pgid = pgid;
+	m->relays = (Relay**) malloc(n * sizeof(Relay*));
+	m->n = n;
+
+	struct itimerspec t = {{0, METER_INTERVAL_MS * 1000000}, {0, METER_INTERVAL_MS * 1000000}};
+	if (m->fd == -1 || m->relays == NULL || timerfd_settime(m->fd, 0, &t, NULL) == -1
+		|| add_Event(m->fd, POLLIN, on_Meter_tick, m) == -1)
+	{
+		perror(blank_face " yash: meter");
+		if (m->fd != -1)
+			close(m->fd);
+		free(m->relays);
+		free(m);
+		return NULL;
+	}
+
+	for (int i=0; i < n; i++)
+	{
+		m->relays[i] = relays[i];
+		relays[i]->meter = m;
+	}
+
+	return m;
+}
+
+void destroy_Meter (Meter* m)
+{
+	if (m == NULL)
+		return;
+
+	for (int i=0; i < m->n; i++)
+		m->relays[i]->meter = NULL;
+	m->shown = 0;
+	finish_Meter(m);
+
+	free(m->relays);
+	free(m);
+}
+
+
+#endif /* RELAY_H */
+
+
+
+/* Test RELAY */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <string.h>			// memset
+#include <signal.h>			// signal, SIGPIPE
+
+/* Writer -> relay -> reader, inside this process: every byte has to come out the other side */
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+	signal(SIGPIPE, SIG_IGN);
+
+	int upstream[2];
+	pipe2(upstream, O_CLOEXEC);
+	fcntl(upstream[1], F_SETFL, O_NONBLOCK);
+
+	Relay* r = make_Relay();
+	int downstream = start_Relay(r, upstream[0]);
+	fcntl(downstream, F_SETFL, O_NONBLOCK);
+
+	char block[4096];
+	memset(block, 'x', sizeof(block));
+	long long total = 64LL << 20, written = 0, read_back = 0;
+
+	while (r->in != -1 || read_back < written)
+	{
+		wait_Events(10, -1);
+
+		while (upstream[1] != -1 && written < total && write(upstream[1], block, sizeof(block)) > 0)
+			written += sizeof(block);
+		if (upstream[1] != -1 && written == total)
+		{
+			close(upstream[1]);
+			upstream[1] = -1;
+		}
+
+		ssize_t bytes;
+		while ((bytes = read(downstream, block, sizeof(block))) > 0)
+			read_back += bytes;
+		if (bytes == 0)
+			break;
+	}
+
+	printf("written %lld, relayed %lld, read %lld\n", written, r->bytes, read_back);
+	destroy_Relay(r);
+
+	return (read_back == total) ? 0 : 1;
+}
+#endif
+/* Test RELAY */
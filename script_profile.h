@@ -0,0 +1,402 @@
+#ifndef SCRIPT_PROFILE_H
+#define SCRIPT_PROFILE_H
+
+#include <sys/time.h>		// setitimer, ITIMER_PROF
+#include <sys/resource.h>	// getrusage
+#include <signal.h>			// sigaction, SIGPROF, sig_atomic_t
+#include <stdio.h>			// fopen, fprintf
+#include <stdlib.h>			// calloc, realloc, qsort, free
+#include <string.h>			// strdup, strrchr
+#include "job.h"
+#include "events.h"
+#include "faces.h"
+
+#define PROFILE_SAMPLE_US 1000
+
+
+/* yash --profile=out script: where the time of a script goes, line by line.
+
+   Jobs: wall time from launch_Job to the last reap and their stages' CPU (wait4),
+   charged to the line the job came from, background jobs included.
+   The shell: SIGPROF every PROFILE_SAMPLE_US of its own CPU (ITIMER_PROF: at best
+   once per kernel tick), counted by phase (parsing, builtins, launching, waiting on
+   children) and charged to the line being run. Sampling only gives the split: the
+   shell's CPU per line is its total (getrusage) shared out in proportion to the
+   samples.
+
+   "out" gets the report, sorted by wall time; "out.folded" the same time as
+   collapsed stacks in microseconds of CPU (script;line;yash;phase and
+   script;line;children;command), for flamegraph.pl and speedscope. */
+
+typedef enum
+{
+	Phase_Other,			// reading the script, cleaning up jobs
+	Phase_Parse,
+	Phase_Builtin,
+	Phase_Launch,
+	Phase_Wait,
+	PHASE_COUNT
+} Shell_Phase;
+
+static const char* phase_names[] = {"other", "parse", "builtin", "launch", "wait"};
+
+typedef struct Stage_Time
+{
+	char* command;			// argv[0]
+	long long cpu_ns;
+} Stage_Time;
+
+typedef struct Line_Profile
+{
+	char* text;				// NULL for a line never run
+	int jobs;				// finished jobs launched from it
+	long long wall_ns;		// launch to last reap, summed over its jobs
+	long long child_ns;		// user + system of their stages
+	unsigned long long samples[PHASE_COUNT];
+	Stage_Time* stages;		// child CPU per command
+	int n_stages;
+} Line_Profile;
+
+
+static volatile sig_atomic_t profile_phase = Phase_Other;
+static volatile unsigned int phase_samples[PHASE_COUNT];	// since the last enter_Line
+
+static struct
+{
+	const char* script;
+	FILE* out;				// the report, or NULL when not profiling
+	FILE* stacks;			// collapsed stacks
+	Line_Profile* lines;	// by line number
+	int n;
+	int current;
+	long long start_ns;
+	double shell_cpu;		// at the start
+} profile;
+
+
+static void on_SIGPROF (int signo)
+{
+	phase_samples[profile_phase]++;
+}
+
+static inline void set_Phase (Shell_Phase phase)
+{
+	profile_phase = phase;
+}
+
+static double get_rusage_cpu (int who)
+{
+	struct rusage usage;
+	getrusage(who, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/* Returns -1 (after printing why) if sampling can't be set up */
+int start_Script_Profile (const char* path, const char* script)
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_SIGPROF;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	char folded[4096];
+	snprintf(folded, sizeof(folded), "%s.folded", path);
+	if ((profile.out = fopen(path, "we")) == NULL || (profile.stacks = fopen(folded, "we")) == NULL)
+	{
+		fprintf(stderr, "yash: --profile: ");
+		perror(profile.out == NULL ? path : folded);
+		if (profile.out != NULL)
+			fclose(profile.out);
+		profile.out = NULL;
+		return -1;
+	}
+
+	struct itimerval timer = {{0, PROFILE_SAMPLE_US}, {0, PROFILE_SAMPLE_US}};
+	if (sigaction(SIGPROF, &action, NULL) == -1 || setitimer(ITIMER_PROF, &timer, NULL) == -1)
+	{
+		perror(blank_face " yash: --profile");
+		fclose(profile.out);
+		fclose(profile.stacks);
+		profile.out = profile.stacks = NULL;
+		return -1;
+	}
+
+	profile.script = script;
+	profile.start_ns = get_monotonic_ns();
+	profile.shell_cpu = get_rusage_cpu(RUSAGE_SELF);
+	return 0;
+}
+
+static Line_Profile* get_Line_Profile (int line)
+{
+	if (line >= profile.n)
+	{
+		int n = (line + 1 > 2 * profile.n) ? line + 1 : 2 * profile.n;
+		Line_Profile* lines = (Line_Profile*) realloc(profile.lines, n * sizeof(Line_Profile));
+		if (lines == NULL)
+			return NULL;
+		memset(lines + profile.n, 0, (n - profile.n) * sizeof(Line_Profile));
+		profile.lines = lines;
+		profile.n = n;
+	}
+
+	return &profile.lines[line];
+}
+
+/* Samples taken since the last call go to the line that was running */
+static void collect_Samples ()
+{
+	Line_Profile* l = get_Line_Profile(profile.current);
+
+	for (int i=0; i < PHASE_COUNT; i++)
+	{
+		unsigned int samples = __atomic_exchange_n(&phase_samples[i], 0, __ATOMIC_RELAXED);
+		if (l != NULL)
+			l->samples[i] += samples;
+	}
+}
+
+/* Before running a line: text is kept for the report */
+void enter_Line (int line, const char* text)
+{
+	if (profile.out == NULL)
+		return;
+
+	collect_Samples();
+	profile.current = line;
+
+	Line_Profile* l = get_Line_Profile(line);
+	if (l != NULL && l->text == NULL)
+		l->text = strdup(text);
+}
+
+/* A finished job from the script: before clean_Jobs removes it */
+void record_Script_Job (Job* j)
+{
+	if (profile.out == NULL || j->line == 0 || j->end_ns == 0)
+		return;
+
+	Line_Profile* l = get_Line_Profile(j->line);
+	if (l == NULL)
+		return;
+
+	l->jobs++;
+	l->wall_ns += j->end_ns - j->start_ns;
+
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		long long cpu = (p->usage.ru_utime.tv_sec + p->usage.ru_stime.tv_sec) * 1000000000LL
+			+ (p->usage.ru_utime.tv_usec + p->usage.ru_stime.tv_usec) * 1000LL;
+		l->child_ns += cpu;
+
+		const char* command = (p->argv != NULL && p->argv[0] != NULL) ? p->argv[0] : "?";
+		int s = 0;
+		while (s < l->n_stages && strcmp(l->stages[s].command, command) != 0)
+			s++;
+		if (s == l->n_stages)
+		{
+			Stage_Time* stages = (Stage_Time*) realloc(l->stages, (s + 1) * sizeof(Stage_Time));
+			if (stages == NULL)
+				continue;
+			l->stages = stages;
+			l->stages[s] = (Stage_Time) {strdup(command), 0};
+			l->n_stages++;
+		}
+		l->stages[s].cpu_ns += cpu;
+	}
+}
+
+
+/* Frames can't contain ';' (the separator) or a newline */
+static void print_frame (FILE* out, const char* str)
+{
+	for (; *str != 0; str++)
+		fputc((*str == ';' || *str == '\n') ? ',' : *str, out);
+}
+
+static int compare_line_wall (const void* a, const void* b)
+{
+	const Line_Profile* x = *(const Line_Profile**) a;
+	const Line_Profile* y = *(const Line_Profile**) b;
+	unsigned long long u = x->wall_ns, v = y->wall_ns, su = 0, sv = 0;
+
+	for (int i=0; i < PHASE_COUNT; i++)
+	{
+		su += x->samples[i];
+		sv += y->samples[i];
+	}
+
+	if (u != v)
+		return (u < v) ? 1 : -1;
+	return (su < sv) - (su > sv);
+}
+
+/* Stops sampling and writes both files. Returns -1 (after printing why) on error. */
+int finish_Script_Profile ()
+{
+	if (profile.out == NULL)
+		return 0;
+
+	struct itimerval off = {{0, 0}, {0, 0}};
+	setitimer(ITIMER_PROF, &off, NULL);
+	collect_Samples();
+
+	double wall = (get_monotonic_ns() - profile.start_ns) / 1e9;
+	double shell_cpu = get_rusage_cpu(RUSAGE_SELF) - profile.shell_cpu;
+	unsigned long long total_samples = 0, phase_total[PHASE_COUNT] = {0};
+	long long child_ns = 0;
+
+	Line_Profile** order = (Line_Profile**) malloc((profile.n + 1) * sizeof(Line_Profile*));
+	int n = 0;
+	for (int i=0; i < profile.n; i++)
+	{
+		Line_Profile* l = &profile.lines[i];
+		for (int p=0; p < PHASE_COUNT; p++)
+		{
+			phase_total[p] += l->samples[p];
+			total_samples += l->samples[p];
+		}
+		child_ns += l->child_ns;
+		if (l->text != NULL)
+			order[n++] = l;
+	}
+
+	/* Nothing to show for blank lines, or builtins too quick to be sampled */
+	int shown = 0;
+	for (int i=0; i < n; i++)
+	{
+		unsigned long long samples = 0;
+		for (int p=0; p < PHASE_COUNT; p++)
+			samples += order[i]->samples[p];
+		if (order[i]->jobs > 0 || samples > 0)
+			order[shown++] = order[i];
+	}
+	n = shown;
+	qsort(order, n, sizeof(Line_Profile*), compare_line_wall);
+
+	/* Report */
+	double per_sample = total_samples ? shell_cpu / total_samples : 0; // seconds
+
+	FILE* out = profile.out;
+	FILE* stacks = profile.stacks;
+
+	fprintf(out, "%s: %.3fs wall, children %.3fs cpu, shell %.3fs cpu (%llu samples:",
+		profile.script, wall, child_ns / 1e9, shell_cpu, total_samples);
+	for (int p=0; p < PHASE_COUNT; p++)
+		fprintf(out, " %s %llu", phase_names[p], phase_total[p]);
+	fprintf(out, ")\n\n%6s %5s %10s %10s %10s  %s\n", "line", "jobs", "wall", "child cpu", "shell cpu", "command");
+
+	for (int i=0; i < n; i++)
+	{
+		Line_Profile* l = order[i];
+		unsigned long long samples = 0;
+		for (int p=0; p < PHASE_COUNT; p++)
+			samples += l->samples[p];
+
+		fprintf(out, "%6d %5d %9.3fs %9.3fs %9.3fs  %s\n", (int) (l - profile.lines), l->jobs,
+			l->wall_ns / 1e9, l->child_ns / 1e9, samples * per_sample, l->text);
+	}
+
+	/* Collapsed stacks, in line order */
+	for (int i=0; i < profile.n; i++)
+	{
+		Line_Profile* l = &profile.lines[i];
+		if (l->text == NULL)
+			continue;
+
+		for (int p=0; p < PHASE_COUNT; p++)
+			if (l->samples[p] > 0)
+			{
+				print_frame(stacks, profile.script);
+				fprintf(stacks, ";%d: ", i);
+				print_frame(stacks, l->text);
+				fprintf(stacks, ";yash;%s %.0f\n", phase_names[p], l->samples[p] * per_sample * 1e6);
+			}
+
+		for (int s=0; s < l->n_stages; s++)
+			if (l->stages[s].cpu_ns >= 1000)
+			{
+				print_frame(stacks, profile.script);
+				fprintf(stacks, ";%d: ", i);
+				print_frame(stacks, l->text);
+				fprintf(stacks, ";children;");
+				print_frame(stacks, l->stages[s].command);
+				fprintf(stacks, " %lld\n", l->stages[s].cpu_ns / 1000);
+			}
+	}
+
+	int result = 0;
+	if ((fclose(out) == EOF) | (fclose(stacks) == EOF))
+	{
+		perror(blank_face " yash: --profile");
+		result = -1;
+	}
+
+	for (int i=0; i < profile.n; i++)
+	{
+		free(profile.lines[i].text);
+		for (int s=0; s < profile.lines[i].n_stages; s++)
+			free(profile.lines[i].stages[s].command);
+		free(profile.lines[i].stages);
+	}
+	free(profile.lines);
+	free(order);
+	memset(&profile, 0, sizeof(profile));
+
+	return result;
+}
+
+
+#endif /* SCRIPT_PROFILE_H */
+
+
+
+/* Test SCRIPT_PROFILE */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf, fopen, fgets
+#include "job_control.h"
+
+static void print_file (const char* path)
+{
+	char line[512];
+	FILE* f = fopen(path, "r");
+	while (f != NULL && fgets(line, sizeof(line), f) != NULL)
+		fputs(line, stdout);
+	if (f != NULL)
+		fclose(f);
+}
+
+/* Line 1 keeps the shell busy, line 2 a child: each has to show up where it belongs */
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+	interactive = 0;
+	if (start_Script_Profile("/tmp/yash_profile_test", "test.sh") == -1)
+		return 1;
+
+	enter_Line(1, "shell busy");
+	set_Phase(Phase_Parse);
+	for (long long end = get_monotonic_ns() + 100000000; get_monotonic_ns() < end; )
+		;
+
+	enter_Line(2, "timeout 0.2 yes > /dev/null");
+	strcpy(input_buffer, "timeout 0.2 yes > /dev/null");
+	Job* j = make_Job(set_tokens(" \t"));
+	j->line = 2;
+	current_Job = j;
+	set_Phase(Phase_Launch);
+	launch_Job(j);
+	set_Phase(Phase_Wait);
+	wait_Job(j);
+	record_Script_Job(j);
+
+	if (finish_Script_Profile() == -1)
+		return 1;
+
+	print_file("/tmp/yash_profile_test");
+	print_file("/tmp/yash_profile_test.folded");
+	return 0;
+}
+#endif
+/* Test SCRIPT_PROFILE */
@@ -0,0 +1,292 @@
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <sys/mman.h>		// mmap, MAP_SHARED, MAP_ANONYMOUS
+#include <unistd.h>			// getpid
+#include <stdio.h>			// printf, snprintf
+#include <string.h>			// strcmp, memset
+#include "events.h"
+
+#define STATS_SUB_BITS 4	// 16 buckets per power of two: values within ~6%
+#define STATS_BUCKETS ((64 - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+#define EXEC_SLOTS 4096
+
+
+/* Latency histograms of the shell's own overhead, always on. Each is HDR-style:
+   log-bucketed with STATS_SUB_BITS of linear resolution inside every power of two,
+   so recording a value is a count-leading-zeros, a shift and an increment.
+
+   spawn     fork returned in the shell -> the child calling execvp (the start
+             barrier included). Children stamp the time into a shared page: see
+             claim_Exec_Slot.
+   parse     line read -> job built
+   launch    line read -> launch_Job done (prompt to launch)
+   job       launch_Job entered -> last stage reaped
+   reap lag  the event loop waking up on SIGCHLD -> the process state updated.
+             The kernel doesn't timestamp exits, so a shell busy elsewhere before
+             it polls again is not counted. */
+
+typedef struct Histogram
+{
+	const char* name;
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned int buckets[STATS_BUCKETS];
+} Histogram;
+
+typedef enum
+{
+	Spawn_Stat,
+	Parse_Stat,
+	Launch_Stat,
+	Job_Stat,
+	Reap_Lag_Stat,
+	STAT_COUNT
+} Stat;
+
+static Histogram histograms[STAT_COUNT] =
+{
+	{"spawn"}, {"parse"}, {"launch"}, {"job"}, {"reap lag"}
+};
+
+
+static inline int get_bucket (unsigned long long value)
+{
+	if (value < (1 << STATS_SUB_BITS))
+		return value;
+
+	int shift = 63 - __builtin_clzll(value) - STATS_SUB_BITS;
+	return ((shift + 1) << STATS_SUB_BITS) + ((value >> shift) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+/* Smallest value that lands in the bucket */
+static unsigned long long get_bucket_floor (int bucket)
+{
+	if (bucket < (1 << STATS_SUB_BITS))
+		return bucket;
+
+	int shift = (bucket >> STATS_SUB_BITS) - 1;
+	return ((1ULL << STATS_SUB_BITS) + (bucket & ((1 << STATS_SUB_BITS) - 1))) << shift;
+}
+
+static inline void record_Stat (Stat s, long long ns)
+{
+	if (ns < 0)
+		return;
+
+	Histogram* h = &histograms[s];
+	h->buckets[get_bucket(ns)]++;
+	h->sum += ns;
+	if (h->count++ == 0 || (unsigned long long) ns < h->min)
+		h->min = ns;
+	if ((unsigned long long) ns > h->max)
+		h->max = ns;
+}
+
+/* Middle of the bucket holding the q-quantile (0..1), clipped to min..max */
+static unsigned long long get_percentile (const Histogram* h, double q)
+{
+	unsigned long long rank = q * h->count, seen = 0;
+
+	for (int b=0; b < STATS_BUCKETS; b++)
+		if ((seen += h->buckets[b]) > rank)
+		{
+			unsigned long long floor = get_bucket_floor(b);
+			unsigned long long top = (b + 1 < STATS_BUCKETS) ? get_bucket_floor(b + 1) - 1 : h->max;
+			unsigned long long middle = floor + (top - floor) / 2;
+			return (middle < h->min) ? h->min : (middle > h->max) ? h->max : middle;
+		}
+
+	return h->max;
+}
+
+
+/* Exec stamps: a MAP_SHARED page set up once, before the first fork, so every child
+   shares it. Each forked child gets a slot and writes its pid and the time right
+   before execvp; the shell reads the slot back when it reaps the child. Slots are
+   handed out round robin, and the pid tells a stale slot from a reused one. */
+
+typedef struct Exec_Slot
+{
+	volatile pid_t pid;
+	volatile long long ns;
+} Exec_Slot;
+
+static Exec_Slot* exec_slots = NULL;
+static unsigned int next_exec_slot = 0;
+
+/* In the shell, before fork. Returns -1 if stamps aren't available. */
+int claim_Exec_Slot ()
+{
+	if (exec_slots == NULL)
+	{
+		void* page = mmap(NULL, EXEC_SLOTS * sizeof(Exec_Slot), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+		if (page == MAP_FAILED)
+			return -1;
+		exec_slots = (Exec_Slot*) page;
+	}
+
+	int slot = next_exec_slot++ % EXEC_SLOTS;
+	exec_slots[slot].pid = 0;
+	return slot;
+}
+
+/* In the child, right before execvp (with ok = 0 if the exec failed) */
+void stamp_Exec_Slot (int slot, int ok)
+{
+	if (slot == -1 || exec_slots == NULL)
+		return;
+
+	exec_slots[slot].ns = get_monotonic_ns();
+	exec_slots[slot].pid = ok ? getpid() : 0;
+}
+
+/* In the shell: the child's exec time, or 0 if it didn't stamp it */
+long long read_Exec_Slot (int slot, pid_t pid)
+{
+	if (slot == -1 || exec_slots == NULL || exec_slots[slot].pid != pid)
+		return 0;
+
+	return exec_slots[slot].ns;
+}
+
+
+static const char* format_ns (unsigned long long ns, char* buffer, size_t size)
+{
+	if (ns >= 1000000000ULL)
+		snprintf(buffer, size, "%.2fs", ns / 1e9);
+	else if (ns >= 1000000)
+		snprintf(buffer, size, "%.2fms", ns / 1e6);
+	else if (ns >= 1000)
+		snprintf(buffer, size, "%.1fus", ns / 1e3);
+	else
+		snprintf(buffer, size, "%lluns", ns);
+	return buffer;
+}
+
+static const double stat_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+void print_Stats ()
+{
+	printf("%-10s %8s %9s %9s %9s %9s %9s %9s %9s\n",
+		"", "count", "min", "p50", "p90", "p99", "p99.9", "max", "mean");
+
+	for (int s=0; s < STAT_COUNT; s++)
+	{
+		Histogram* h = &histograms[s];
+		char buffer[8][16];
+
+		printf("%-10s %8llu", h->name, h->count);
+		if (h->count == 0)
+		{
+			printf("\n");
+			continue;
+		}
+
+		printf(" %9s", format_ns(h->min, buffer[0], sizeof(buffer[0])));
+		for (int q=0; q < 4; q++)
+			printf(" %9s", format_ns(get_percentile(h, stat_quantiles[q]), buffer[q+1], sizeof(buffer[0])));
+		printf(" %9s %9s\n", format_ns(h->max, buffer[5], sizeof(buffer[0])),
+			format_ns(h->sum / h->count, buffer[6], sizeof(buffer[0])));
+	}
+}
+
+void print_Stats_json ()
+{
+	printf("{");
+	for (int s=0; s < STAT_COUNT; s++)
+	{
+		Histogram* h = &histograms[s];
+
+		printf("%s\"", s ? ", " : "");
+		for (const char* c = h->name; *c != 0; c++)
+			putchar(*c == ' ' ? '_' : *c);
+		printf("\": {\"count\": %llu", h->count);
+
+		if (h->count > 0)
+			printf(", \"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, \"mean_ns\": %llu",
+				h->min, get_percentile(h, 0.5), get_percentile(h, 0.9), get_percentile(h, 0.99),
+				get_percentile(h, 0.999), h->max, h->sum / h->count);
+		printf("}");
+	}
+	printf("}\n");
+}
+
+void reset_Stats ()
+{
+	for (int s=0; s < STAT_COUNT; s++)
+	{
+		const char* name = histograms[s].name;
+		memset(&histograms[s], 0, sizeof(histograms[s]));
+		histograms[s].name = name;
+	}
+}
+
+/* stats [-j] [-r]
+   Returns -1 on a usage error */
+int stats_builtin (char** args)
+{
+	int json = 0, reset = 0;
+
+	for (; *args != NULL; args++)
+		if (strcmp(*args, "-j") == 0)
+			json = 1;
+		else if (strcmp(*args, "-r") == 0)
+			reset = 1;
+		else
+			return -1;
+
+	if (json)
+		print_Stats_json();
+	else if (!reset)
+		print_Stats();
+
+	if (reset)
+		reset_Stats();
+
+	return 0;
+}
+
+
+#endif /* STATS_H */
+
+
+
+/* Test STATS */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <stdlib.h>			// rand
+
+int main(int argc, char* argv[])
+{
+	/* Buckets are contiguous and every value lands in a bucket whose floor is at or below it */
+	for (int b=1; b < STATS_BUCKETS; b++)
+		if (get_bucket(get_bucket_floor(b)) != b || get_bucket(get_bucket_floor(b) - 1) != b - 1)
+		{
+			printf("bucket %d: floor %llu\n", b, get_bucket_floor(b));
+			return 1;
+		}
+
+	/* Uniform 0..10ms: p50 ~5ms, p99 ~9.9ms */
+	for (int i=0; i < 1000000; i++)
+		record_Stat(Job_Stat, rand() % 10000000);
+
+	long long start = get_monotonic_ns();
+	for (int i=0; i < 10000000; i++)
+		record_Stat(Spawn_Stat, i);
+	printf("record_Stat: %.1f ns each\n", (get_monotonic_ns() - start) / 1e7);
+
+	print_Stats();
+	print_Stats_json();
+
+	char* reset[] = {"-r", NULL};
+	stats_builtin(reset);
+	printf("after reset: %llu\n", histograms[Job_Stat].count);
+
+	return 0;
+}
+#endif
+/* Test STATS */
@@ -0,0 +1,399 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stdio.h>			// getline, fopen, printf
+#include <stdlib.h>			// malloc, calloc, free, atoi
+#include <string.h>			// strcmp, strtok_r, strdup
+#include <unistd.h>			// sysconf
+#include <fcntl.h>			// open, O_CLOEXEC
+#include <signal.h>			// kill, SIGTERM, SIGCONT
+#include "tokenize.h"
+#include "job.h"
+#include "job_control.h"
+#include "events.h"
+#include "faces.h"
+
+
+/* tasks [-j cores] [file]
+
+   Reads a task graph, one node per line (file or stdin), e.g.
+
+		# name: dependencies... -- command
+		fetch:              -- curl -sO https://example.com/src.tgz
+		unpack: fetch       -- tar xzf src.tgz
+		lint:               -- ./lint.sh
+		build: unpack lint  -- make -j8
+
+   and runs it: every node whose dependencies all succeeded is launched as a normal
+   background Job, at most "cores" at once. A node that fails (any stage exits
+   non-zero) cancels everything that depends on it. At the end, per-node timings
+   and the critical path (longest chain of actual durations) are reported. */
+
+typedef enum
+{
+	Waiting_Task,
+	Running_Task,
+	Succeeded_Task,
+	Failed_Task,
+	Cancelled_Task
+} Task_State;
+
+static const char* task_state_strings[] = {"waiting", "running", "ok", "failed", "cancelled"};
+
+typedef struct Task
+{
+	char* name;
+	char** command;			// owned token list
+	char** dep_names;
+	int* deps;				// indices into the task list
+	int n_deps;
+	int pending;			// dependencies not yet succeeded
+	Task_State state;
+	int status;
+	Job* j;
+	long long start_ns, end_ns;
+	long long path_ns;		// longest chain of durations ending here
+	int path_prev;			// previous node on that chain, or -1
+} Task;
+
+
+static int find_Task (Task* tasks, int n, const char* name)
+{
+	for (int i=0; i < n; i++)
+		if (strcmp(tasks[i].name, name) == 0)
+			return i;
+
+	return -1;
+}
+
+static void free_Tasks (Task* tasks, int n)
+{
+	for (int i=0; i < n; i++)
+	{
+		free(tasks[i].name);
+		free(tasks[i].command);
+		free(tasks[i].dep_names);
+		free(tasks[i].deps);
+	}
+	free(tasks);
+}
+
+/* Returns the number of tasks read, or -1 on a malformed graph. */
+static int read_Tasks (FILE* f, Task** result)
+{
+	int n = 0, capacity = 16, error = 0;
+	Task* tasks = (Task*) calloc(capacity, sizeof(Task));
+
+	char* line = NULL;
+	size_t size = 0;
+	int line_number = 0;
+
+	while (!error && getline(&line, &size, f) != -1)
+	{
+		line_number++;
+
+		char* tokens[MAX_TOKENS+1];
+		int count = 0;
+		char* save = NULL;
+		for (char* t = strtok_r(line, " \t\n", &save); t != NULL && count < MAX_TOKENS; t = strtok_r(NULL, " \t\n", &save))
+			tokens[count++] = t;
+		tokens[count] = NULL;
+
+		if (count == 0 || tokens[0][0] == '#')
+			continue;
+
+		size_t len = strlen(tokens[0]);
+		int separator = get_token_index(tokens, "--");
+		if (len < 2 || tokens[0][len-1] != ':' || separator == -1 || no_tokens(&tokens[separator+1]))
+		{
+			fprintf(stderr, "yash: tasks: line %d: expected \"name: deps... -- command\"\n", line_number);
+			error = 1;
+			break;
+		}
+
+		tokens[0][len-1] = 0;
+		if (find_Task(tasks, n, tokens[0]) != -1)
+		{
+			fprintf(stderr, "yash: tasks: line %d: %s is defined twice\n", line_number, tokens[0]);
+			error = 1;
+			break;
+		}
+
+		if (n == capacity)
+			tasks = (Task*) realloc(tasks, (capacity *= 2) * sizeof(Task));
+
+		Task* t = &tasks[n++];
+		memset(t, 0, sizeof(Task));
+		t->name = strdup(tokens[0]);
+		t->command = copy_tokens(&tokens[separator+1]);
+		t->path_prev = -1;
+
+		tokens[separator] = NULL;
+		t->dep_names = copy_tokens(&tokens[1]);
+		t->n_deps = count_tokens(t->dep_names);
+		t->deps = (int*) malloc((t->n_deps + 1) * sizeof(int));
+	}
+	free(line);
+
+
+	/* Resolve dependency names */
+	for (int i=0; i < n && !error; i++)
+		for (int k=0; k < tasks[i].n_deps && !error; k++)
+			if ((tasks[i].deps[k] = find_Task(tasks, n, tasks[i].dep_names[k])) == -1)
+			{
+				fprintf(stderr, "yash: tasks: %s: unknown dependency %s\n", tasks[i].name, tasks[i].dep_names[k]);
+				error = 1;
+			}
+
+
+	/* Refuse cycles (Kahn's algorithm on a scratch copy of the in-degrees) */
+	if (!error)
+	{
+		int in_degree[n+1], order[n+1], sorted = 0;
+		for (int i=0; i < n; i++)
+			if ((in_degree[i] = tasks[i].n_deps) == 0)
+				order[sorted++] = i;
+
+		for (int s=0; s < sorted; s++)
+			for (int i=0; i < n; i++)
+				for (int k=0; k < tasks[i].n_deps; k++)
+					if (tasks[i].deps[k] == order[s] && --in_degree[i] == 0)
+						order[sorted++] = i;
+
+		if (sorted != n)
+		{
+			fprintf(stderr, "yash: tasks: dependency cycle\n");
+			error = 1;
+		}
+	}
+
+	if (error)
+	{
+		free_Tasks(tasks, n);
+		return -1;
+	}
+
+	*result = tasks;
+	return n;
+}
+
+static int start_Task (Task* t)
+{
+	/* make_Job clips its tokens in place: give it a scratch copy */
+	char** tokens = copy_tokens(t->command);
+	t->j = make_Job(tokens);
+	free(tokens);
+
+	if (t->j == NULL)
+		return -1;
+
+	t->j->foreground = 0;
+	t->j->next = current_Job;
+	current_Job = t->j;
+
+	/* Not the terminal: a node reading it would stop (SIGTTIN), and the graph with it */
+	Process* first = t->j->p;
+	if (first->in == -1 && (first->in = open("/dev/null", O_RDONLY | O_CLOEXEC)) != -1)
+		first->close_me[0] = 1;
+
+	t->start_ns = get_monotonic_ns();
+	if (launch_Job(t->j) == -1)
+	{
+		/* Failed like a non-zero exit (the caller cancels its dependants); left in the job table to be reaped */
+		abort_Launch(t->j);
+		t->j = NULL;
+		t->end_ns = t->start_ns;
+		return -1;
+	}
+	t->state = Running_Task;
+
+	return 0;
+}
+
+static void cancel_Dependants (Task* tasks, int n, int failed)
+{
+	for (int i=0; i < n; i++)
+		if (tasks[i].state == Waiting_Task)
+			for (int k=0; k < tasks[i].n_deps; k++)
+				if (tasks[i].deps[k] == failed)
+				{
+					tasks[i].state = Cancelled_Task;
+					cancel_Dependants(tasks, n, i);
+					break;
+				}
+}
+
+static void print_Tasks (Task* tasks, int n, long long start_ns)
+{
+	int end = -1;
+
+	printf("%-20s %-10s %10s %10s\n", "task", "result", "start", "duration");
+	for (int i=0; i < n; i++)
+	{
+		Task* t = &tasks[i];
+		if (t->state == Succeeded_Task || t->state == Failed_Task)
+		{
+			printf("%-20s %-6s %3d %9.3fs %9.3fs\n", t->name, task_state_strings[t->state], t->status,
+				(t->start_ns - start_ns) / 1e9, (t->end_ns - t->start_ns) / 1e9);
+
+			if (end == -1 || t->path_ns > tasks[end].path_ns)
+				end = i;
+		}
+		else
+			printf("%-20s %s\n", t->name, task_state_strings[t->state]);
+	}
+
+	if (end == -1)
+		return;
+
+	/* Walk the critical path back from its last node */
+	int path[n], length = 0;
+	for (int i = end; i != -1; i = tasks[i].path_prev)
+		path[length++] = i;
+
+	printf("critical path (%.3fs):", tasks[end].path_ns / 1e9);
+	for (int i = length-1; i >= 0; i--)
+		printf(" %s%s", tasks[path[i]].name, i ? " ->" : "\n");
+}
+
+/* Returns -1 on a usage error */
+int run_Tasks (char** args)
+{
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!no_tokens(args) && strcmp(args[0], "-j") == 0)
+	{
+		if (args[1] == NULL)
+			return -1;
+		cores = atoi(args[1]);
+		args += 2;
+	}
+	if (cores <= 0)
+		cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	FILE* f = no_tokens(args) ? stdin : fopen(args[0], "re");
+	if (f == NULL)
+	{
+		fprintf(stderr, "yash: tasks: ");
+		perror(args[0]);
+		return 0;
+	}
+
+	Task* tasks = NULL;
+	int n = read_Tasks(f, &tasks);
+	if (f != stdin)
+		fclose(f);
+	else
+		clearerr(stdin); // ^D ended the graph, not the shell
+	if (n <= 0)
+		return 0;
+
+	for (int i=0; i < n; i++)
+		tasks[i].pending = tasks[i].n_deps;
+
+
+	long long start_ns = get_monotonic_ns();
+	int running = 0;
+
+	interrupted = 0;
+	watch_Children();
+
+	while (1)
+	{
+		/* Finished nodes release (or cancel) their dependants */
+		for (int i=0; i < n; i++)
+		{
+			Task* t = &tasks[i];
+			if (t->state != Running_Task || is_Alive(t->j))
+				continue;
+
+			t->end_ns = get_monotonic_ns();
+			t->status = get_exit_status(t->j);
+			t->state = (t->status == 0) ? Succeeded_Task : Failed_Task;
+			remove_Job(t->j);
+			t->j = NULL;
+			running--;
+
+			t->path_ns = t->end_ns - t->start_ns;
+			for (int k=0; k < t->n_deps; k++)
+			{
+				Task* dep = &tasks[t->deps[k]];
+				if (t->path_ns < dep->path_ns + (t->end_ns - t->start_ns))
+				{
+					t->path_ns = dep->path_ns + (t->end_ns - t->start_ns);
+					t->path_prev = t->deps[k];
+				}
+			}
+
+			if (t->state == Failed_Task)
+				cancel_Dependants(tasks, n, i);
+			else
+				for (int d=0; d < n; d++)
+					for (int k=0; k < tasks[d].n_deps; k++)
+						if (tasks[d].deps[k] == i)
+							tasks[d].pending--;
+		}
+
+		/* Launch ready nodes */
+		for (int i=0; i < n && running < cores && !interrupted; i++)
+			if (tasks[i].state == Waiting_Task && tasks[i].pending == 0)
+			{
+				if (start_Task(&tasks[i]) == 0)
+					running++;
+				else
+				{
+					tasks[i].state = Failed_Task;
+					tasks[i].status = 1;
+					cancel_Dependants(tasks, n, i);
+				}
+			}
+
+		if (running == 0)
+			break;
+
+		if (wait_Events(-1, -1) == -1 && errno == EINTR && interrupted)
+			for (int i=0; i < n; i++)
+				if (tasks[i].state == Running_Task)
+				{
+					kill(- tasks[i].j->pgid, SIGTERM);
+					kill(- tasks[i].j->pgid, SIGCONT); // a stopped node only gets it once continued
+				}
+	}
+
+	print_Tasks(tasks, n, start_ns);
+	free_Tasks(tasks, n);
+
+	return 0;
+}
+
+
+#endif /* TASKS_H */
+
+
+
+/* Test TASKS */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf, fopen
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	FILE* f = fopen("tasks_input.txt", "w");
+	fprintf(f,
+		"# A and B run together, C after both, D after a failure never runs\n"
+		"a:       -- sleep 0.2\n"
+		"b:       -- sleep 0.3\n"
+		"c: a b   -- sleep 0.1\n"
+		"bad: a   -- false\n"
+		"d: bad c -- echo never\n");
+	fclose(f);
+
+	char* args[] = {"-j", "4", "tasks_input.txt", NULL};
+	run_Tasks(args);
+	remove("tasks_input.txt");
+
+	return 0;
+}
+#endif
+/* Test TASKS */
@@ -0,0 +1,137 @@
+/* Per-prompt cost budgets.
+
+   make test-budget     (or: ./test_budget ./yash-budget)
+
+   Types fixed command sequences into yash-budget (budget.h) on a pty, one line at a
+   time, and holds what each line cost the shell, up to and including the next prompt,
+   to the budgets below: syscalls (the wrapped ones, plus every read and write) and
+   allocations. A line over budget fails the test; so does one well under it, so that
+   an improvement also lowers the budget instead of leaving room for the next
+   regression. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pty.h"
+
+#define TIMEOUT_MS 5000
+
+
+typedef struct Step
+{
+	const char* name;
+	const char* keys;
+	int settle_ms;		// wait before typing (a background job finishing)
+	int calls, allocs;	// budget
+} Step;
+
+static const Step steps[] =
+{
+	{"idle prompt",			"\n",				0,		6,	0},	// cleans up the warm-up job
+	{"idle prompt",			"\n",				0,		5,	0},	// tcsetpgrp, tcsetattr, poll, read, write
+	{"builtin",				"jobs\n",			0,		5,	0},
+	{"command",				"true\n",			0,		22,	5},	// + one wakeup (poll, read, wait4s)
+	{"pipeline",			"true | true\n",	0,		28,	7},	// if a child's SIGCHLD comes apart
+	{"redirect",			"true > /dev/null\n",	0,	25,	5},
+	{"background",			"sleep 0.1 &\n",	0,		10,	5},
+	{"notification",		"\n",				300,	16,	0},	// reaped while at the prompt
+	{"idle prompt",			"\n",				0,		7,	0},	// prints "Done", cleans it up
+	{"set -o live",			"set -o live\n",	0,		5,	0},
+	{"live segment",		"\n",				0,		6,	0},	// created by the prompt after
+	{"idle prompt, live",	"\n",				0,		5,	0},	// published by its timer only
+	{"set +o live",			"set +o live\n",	0,		5,	0},
+};
+
+
+/* "calls N allocs N frees N name N ...": the next line of the log */
+static int next_Report (FILE* log, char* line, size_t size, long* calls, long* allocs)
+{
+	for (int tries = 0; tries < 100; tries++)
+	{
+		if (fgets(line, size, log) != NULL)
+		{
+			line[strcspn(line, "\n")] = 0;
+			return (sscanf(line, "calls %ld allocs %ld", calls, allocs) == 2) ? 0 : -1;
+		}
+		clearerr(log);
+		usleep(10000);
+	}
+	return -1;
+}
+
+
+int main (int argc, char* argv[])
+{
+	char* shell = (argc > 1) ? argv[1] : "./yash-budget";
+	char log_path[64];
+	snprintf(log_path, sizeof(log_path), "/tmp/yash_budget.%d", getpid());
+	unlink(log_path);
+	setenv("YASH_BUDGET", log_path, 1);
+
+	static Pty t;
+	char* shell_argv[] = {shell, NULL};
+	if (open_Pty(&t, shell_argv) == -1)
+		return 1;
+	if (expect_Pty(&t, "# ", TIMEOUT_MS) == -1)
+	{
+		fprintf(stderr, "test_budget: %s: no prompt\n", shell);
+		return 1;
+	}
+
+	/* The first prompt writes nothing but the baseline: the log exists once it's up */
+	FILE* log = fopen(log_path, "r");
+	if (log == NULL)
+	{
+		perror(log_path);
+		return 1;
+	}
+
+	/* Warm-up: stdio buffers, the first fork's page faults, ... */
+	char line[1024];
+	long calls, allocs;
+	send_Pty(&t, "true\n");
+	if (expect_Pty(&t, "\n# ", TIMEOUT_MS) == -1 || next_Report(log, line, sizeof(line), &calls, &allocs) == -1)
+	{
+		fprintf(stderr, "test_budget: warm-up line got no prompt or report\n");
+		return 1;
+	}
+
+	int failed = 0;
+	printf("%-20s %-18s %11s %9s\n", "", "line", "calls", "allocs");
+	for (size_t i=0; i < sizeof(steps) / sizeof(steps[0]); i++)
+	{
+		const Step* s = &steps[i];
+		if (s->settle_ms)
+			usleep(s->settle_ms * 1000);
+
+		send_Pty(&t, s->keys);
+		if (expect_Pty(&t, "\n# ", TIMEOUT_MS) == -1 || next_Report(log, line, sizeof(line), &calls, &allocs) == -1)
+		{
+			printf("%-20s no prompt or report\n", s->name);
+			failed = 1;
+			break;
+		}
+
+		/* Within the budget, and not so far below it that the budget needs lowering */
+		int over = calls > s->calls || allocs > s->allocs;
+		int under = calls < s->calls / 2 || (s->allocs > 0 && allocs < s->allocs / 2);
+		char keys[32];
+		snprintf(keys, sizeof(keys), "%.*s", (int) strcspn(s->keys, "\n"), s->keys);
+		printf("%-20s %-18s %4ld / %-4d %3ld / %-3d %s\n", s->name, keys, calls, s->calls, allocs, s->allocs,
+			over ? "OVER BUDGET" : under ? "UNDER BUDGET (lower it)" : "");
+		if (over || under)
+		{
+			printf("    %s\n", line);
+			failed = 1;
+		}
+	}
+
+	send_Pty(&t, "exit\n");
+	close_Pty(&t, TIMEOUT_MS);
+	fclose(log);
+	unlink(log_path);
+
+	printf(failed ? "FAILED\n" : "PASSED\n");
+	return failed;
+}
@@ -0,0 +1,180 @@
+/* Fd hygiene stress test.
+
+   make test-fds     (or: gcc -std=gnu99 -D_GNU_SOURCE -Wall -o test_fds test_fds.c && ./test_fds)
+
+   Runs with a small RLIMIT_NOFILE and with extra fds held open (as a long-lived shell
+   would), then launches pipelines of growing width through make_Job/launch_Job, plus
+   many background jobs with redirects at once. Every stage is this same program with
+   "--check": it lists /proc/self/fd and fails unless it sees exactly 0, 1 and 2 (its
+   pipes or redirects). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "job.h"
+
+#define FD_LIMIT 64
+#define LEAKED_FDS 16
+#define JOBS_AT_ONCE 100
+
+
+static int check_fds (const char* stage)
+{
+	DIR* dir = opendir("/proc/self/fd");
+	if (dir == NULL)
+		return 1;
+
+	int bad = 0;
+	for (struct dirent* e = readdir(dir); e != NULL; e = readdir(dir))
+	{
+		if (e->d_name[0] == '.')
+			continue;
+
+		int fd = atoi(e->d_name);
+		if (fd > 2 && fd != dirfd(dir))
+		{
+			char target[256] = {0};
+			char path[64];
+			snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+			readlink(path, target, sizeof(target) - 1);
+			fprintf(stderr, "stage %s: unexpected fd %d -> %s\n", stage, fd, target);
+			bad = 1;
+		}
+	}
+
+	closedir(dir);
+	return bad;
+}
+
+/* "self --check 0 | self --check 1 | ... [> redirect]" */
+static Job* make_Pipeline (const char* self, int width, const char* redirect)
+{
+	char** tokens = (char**) malloc((4 * width + 3) * sizeof(char*));
+	char (*stages)[16] = malloc(width * sizeof(*stages));
+	int n = 0;
+
+	for (int i=0; i < width; i++)
+	{
+		snprintf(stages[i], sizeof(stages[i]), "%d", i);
+		if (i > 0)
+			tokens[n++] = "|";
+		tokens[n++] = (char*) self;
+		tokens[n++] = "--check";
+		tokens[n++] = stages[i];
+	}
+	if (redirect != NULL)
+	{
+		tokens[n++] = ">";
+		tokens[n++] = (char*) redirect;
+	}
+	tokens[n] = NULL;
+
+	Job* j = make_Job(tokens);
+	j->foreground = 0;
+
+	free(tokens);
+	free(stages);
+	return j;
+}
+
+/* Returns the number of stages that failed their check */
+static int wait_Pipeline (Job* j)
+{
+	int failed = 0;
+	for (Process* p = j->p; p != NULL; p = p->next)
+	{
+		int status;
+		if (p->pid == 0 || waitpid(p->pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+	}
+
+	return failed;
+}
+
+static int count_open_fds ()
+{
+	int n = 0;
+	DIR* dir = opendir("/proc/self/fd");
+	for (struct dirent* e = readdir(dir); e != NULL; e = readdir(dir))
+		if (e->d_name[0] != '.')
+			n++;
+	closedir(dir);
+	return n - 1;
+}
+
+
+int main (int argc, char* argv[])
+{
+	if (argc == 3 && strcmp(argv[1], "--check") == 0)
+	{
+		/* Drain stdin so the upstream stage never sees EPIPE */
+		char buffer[512];
+		if (strcmp(argv[2], "0") != 0)
+			while (read(STDIN_FILENO, buffer, sizeof(buffer)) > 0)
+				;
+		return check_fds(argv[2]);
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+	struct rlimit limit = {FD_LIMIT, FD_LIMIT};
+	if (setrlimit(RLIMIT_NOFILE, &limit) == -1)
+		perror("setrlimit");
+
+	/* Inherited/leaked fds without close-on-exec: close_range has to take care of them */
+	for (int i=0; i < LEAKED_FDS; i++)
+		dup(STDERR_FILENO);
+
+	int failures = 0;
+	int baseline = count_open_fds();
+
+
+	/* Wide pipelines */
+	for (int width = 1; width <= MAX_PIPE_MEMBERS; width *= 4)
+	{
+		Job* j = make_Pipeline(argv[0], width, "/dev/null");
+		int launched = (launch_Job(j) == 0);
+		int failed = launched ? wait_Pipeline(j) : width;
+		printf("%4d-stage pipeline: %s (%d bad stages, shell fds %d -> %d)\n", width,
+			failed ? "FAIL" : "ok", failed, baseline, count_open_fds());
+
+		failures += failed;
+		destroy_Job(j);
+	}
+
+
+	/* Many background jobs alive at once, each holding a redirect */
+	Job* jobs[JOBS_AT_ONCE];
+	int launched = 0;
+	for (int i=0; i < JOBS_AT_ONCE; i++)
+	{
+		jobs[i] = make_Pipeline(argv[0], 2, "/dev/null");
+		if (jobs[i] != NULL && launch_Job(jobs[i]) == 0)
+			launched++;
+	}
+	int peak = count_open_fds();
+
+	int failed = 0;
+	for (int i=0; i < JOBS_AT_ONCE; i++)
+		if (jobs[i] != NULL)
+		{
+			failed += wait_Pipeline(jobs[i]);
+			destroy_Job(jobs[i]);
+		}
+	printf("%d background jobs with redirects: %s (%d launched, %d bad stages, shell fds %d while running)\n",
+		JOBS_AT_ONCE, (failed || launched != JOBS_AT_ONCE) ? "FAIL" : "ok", launched, failed, peak);
+	failures += failed + (JOBS_AT_ONCE - launched);
+
+
+	if (count_open_fds() != baseline)
+	{
+		printf("shell leaked %d fds\n", count_open_fds() - baseline);
+		failures++;
+	}
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return failures != 0;
+}
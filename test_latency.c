@@ -0,0 +1,203 @@
+/* End-to-end latency, the way a user sees it.
+
+   make latency     (or: ./test_latency [-n rounds] ./yash)
+
+   Runs yash on a pty (pty.h) and types at it, timing from the keystroke to what
+   shows up on the terminal:
+
+     prompt        Enter on an empty line -> the next "# "
+     output        "echo <mark>" + Enter -> <mark> printed by echo
+     ^C            ^C at a foreground "sleep" -> the next "# "
+     ^Z            ^Z at a foreground "sleep" -> its "[n]+  Stopped" line
+
+   Every round checks what it waits for, so this is also an end-to-end test of the
+   prompt, launching, ^C and ^Z: a missing prompt or notification fails it. ^C and
+   ^Z are typed the moment the job has the terminal, when its stages may still be
+   waiting to exec. Prints the percentiles of each. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pty.h"
+
+#define TIMEOUT_MS 5000
+#define WARMUP_ROUNDS 5
+
+
+typedef struct Latency
+{
+	const char* name;
+	const char* what;
+	long long* ns;
+	int n;
+} Latency;
+
+
+static int compare_ns (const void* a, const void* b)
+{
+	long long x = *(const long long*) a, y = *(const long long*) b;
+	return (x > y) - (x < y);
+}
+
+static void print_Latency (Latency* l)
+{
+	if (l->n == 0)
+	{
+		printf("%-8s %6d\n", l->name, 0);
+		return;
+	}
+
+	qsort(l->ns, l->n, sizeof(long long), compare_ns);
+	const double quantiles[] = {0.5, 0.9, 0.99};
+	printf("%-8s %6d", l->name, l->n);
+	for (int q=0; q < 3; q++)
+		printf(" %9.1f", l->ns[(int) (quantiles[q] * (l->n - 1))] / 1e3);
+	printf(" %9.1f   %s\n", l->ns[l->n - 1] / 1e3, l->what);
+}
+
+
+/* One round of each. Returns -1 (after printing what was missing) on a failure. */
+static int run_Round (Pty* t, int round, Latency* prompt, Latency* output, Latency* interrupt, Latency* stop)
+{
+	char keys[64], mark[32];
+	long long start, end;
+	pid_t shell = tcgetpgrp(t->fd);
+
+	/* Enter -> prompt */
+	start = get_monotonic_ns();
+	send_Pty(t, "\n");
+	if ((end = expect_Pty(t, "\n# ", TIMEOUT_MS)) == -1)
+	{
+		fprintf(stderr, "test_latency: round %d: no prompt after Enter\n", round);
+		return -1;
+	}
+	if (prompt != NULL)
+		prompt->ns[prompt->n++] = end - start;
+
+	/* Command -> its output: echoed as typed, after "echo ", then printed at the start of a line */
+	snprintf(mark, sizeof(mark), "\nmark%d\r", round);
+	snprintf(keys, sizeof(keys), "echo mark%d\n", round);
+	start = get_monotonic_ns();
+	send_Pty(t, keys);
+	if ((end = expect_Pty(t, mark, TIMEOUT_MS)) == -1 || expect_Pty(t, "\n# ", TIMEOUT_MS) == -1)
+	{
+		fprintf(stderr, "test_latency: round %d: echo printed nothing, or no prompt after it\n", round);
+		return -1;
+	}
+	if (output != NULL)
+		output->ns[output->n++] = end - start;
+
+	/* ^C -> prompt */
+	send_Pty(t, "sleep 30\n");
+	if (wait_Foreground_Pty(t, shell, TIMEOUT_MS) == -1)
+	{
+		fprintf(stderr, "test_latency: round %d: sleep never got the terminal\n", round);
+		return -1;
+	}
+	start = get_monotonic_ns();
+	send_Pty(t, "\003");
+	if ((end = expect_Pty(t, "# ", TIMEOUT_MS)) == -1)
+	{
+		fprintf(stderr, "test_latency: round %d: no prompt after ^C\n", round);
+		return -1;
+	}
+	if (interrupt != NULL)
+		interrupt->ns[interrupt->n++] = end - start;
+
+	/* ^Z -> "Stopped", then get rid of the job */
+	send_Pty(t, "sleep 30\n");
+	if (wait_Foreground_Pty(t, shell, TIMEOUT_MS) == -1)
+	{
+		fprintf(stderr, "test_latency: round %d: sleep never got the terminal\n", round);
+		return -1;
+	}
+	start = get_monotonic_ns();
+	send_Pty(t, "\032");
+	if ((end = expect_Pty(t, "Stopped", TIMEOUT_MS)) == -1 || expect_Pty(t, "\n# ", TIMEOUT_MS) == -1)
+	{
+		fprintf(stderr, "test_latency: round %d: no \"Stopped\" or no prompt after ^Z\n", round);
+		return -1;
+	}
+	if (stop != NULL)
+		stop->ns[stop->n++] = end - start;
+
+	/* "Done" comes with the first prompt after the shell has reaped it: Enter until then */
+	send_Pty(t, "kill -KILL %+\n");
+	for (int tries = 0; expect_Pty(t, "Done", 100) == -1; tries++)
+		if (tries * 100 > TIMEOUT_MS || send_Pty(t, "\n") == -1)
+		{
+			fprintf(stderr, "test_latency: round %d: the killed job never showed up as Done\n", round);
+			return -1;
+		}
+	if (expect_Pty(t, "\n# ", TIMEOUT_MS) == -1)
+		return -1;
+	while (expect_Pty(t, "\n# ", 50) != -1)
+		; // one per Enter that crossed the notification
+
+	return 0;
+}
+
+
+int main (int argc, char* argv[])
+{
+	int rounds = 100;
+	char* shell = "./yash";
+
+	for (int i=1; i < argc; i++)
+		if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+			rounds = atoi(argv[++i]);
+		else if (argv[i][0] != '-')
+			shell = argv[i];
+		else
+			rounds = 0;
+	if (rounds <= 0)
+	{
+		fprintf(stderr, "usage: test_latency [-n rounds] [yash]\n");
+		return 2;
+	}
+
+	Latency prompt = {"prompt", "Enter -> next prompt", calloc(rounds, sizeof(long long)), 0};
+	Latency output = {"output", "echo + Enter -> its output", calloc(rounds, sizeof(long long)), 0};
+	Latency interrupt = {"^C", "^C at sleep -> next prompt", calloc(rounds, sizeof(long long)), 0};
+	Latency stop = {"^Z", "^Z at sleep -> \"Stopped\"", calloc(rounds, sizeof(long long)), 0};
+	if (prompt.ns == NULL || output.ns == NULL || interrupt.ns == NULL || stop.ns == NULL)
+	{
+		perror("test_latency");
+		return 1;
+	}
+
+	static Pty t;
+	char* shell_argv[] = {shell, NULL};
+	if (open_Pty(&t, shell_argv) == -1)
+		return 1;
+	if (expect_Pty(&t, "# ", TIMEOUT_MS) == -1)
+	{
+		fprintf(stderr, "test_latency: %s: no prompt\n", shell);
+		return 1;
+	}
+
+	int failed = 0;
+	for (int round = -WARMUP_ROUNDS; round < rounds && !failed; round++)
+		if (round < 0)
+			failed = run_Round(&t, round, NULL, NULL, NULL, NULL) == -1;
+		else
+			failed = run_Round(&t, round, &prompt, &output, &interrupt, &stop) == -1;
+
+	send_Pty(&t, "exit\n");
+	int status = close_Pty(&t, TIMEOUT_MS);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "test_latency: %s didn't exit cleanly\n", shell);
+		failed = 1;
+	}
+
+	printf("%-8s %6s %9s %9s %9s %9s   (us)\n", "", "rounds", "p50", "p90", "p99", "max");
+	print_Latency(&prompt);
+	print_Latency(&output);
+	print_Latency(&interrupt);
+	print_Latency(&stop);
+
+	printf(failed ? "FAILED\n" : "PASSED\n");
+	return failed;
+}
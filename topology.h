@@ -0,0 +1,250 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdio.h>			// fopen, fgets, snprintf
+#include <string.h>			// memcmp, memcpy, strchr
+#include "job_limits.h"
+
+#define MAX_DOMAINS 256
+
+
+/* CPU cache topology, read once from /sys/devices/system/cpu and cached.
+   CPUs are grouped by the L2 they share (usually SMT siblings) and by the L3 they
+   share (a socket, or a CCX on chiplet parts). Without cache info in sysfs the
+   physical package stands in for L3 and the core for L2. */
+
+typedef struct Cpu_Group
+{
+	unsigned long cpus[CPU_MASK_WORDS];
+	int n_cpus;
+} Cpu_Group;
+
+static struct
+{
+	int loaded;
+	Cpu_Group l2[MAX_DOMAINS];
+	int n_l2;
+	Cpu_Group l3[MAX_DOMAINS];
+	int n_l3;
+} topology;
+
+
+static int has_cpu (const unsigned long* cpus, int cpu)
+{
+	return (cpus[cpu / (8 * sizeof(unsigned long))] >> (cpu % (8 * sizeof(unsigned long)))) & 1;
+}
+
+static int count_cpus (const unsigned long* cpus)
+{
+	int n = 0;
+	for (int cpu=0; cpu < MAX_CPUS; cpu++)
+		n += has_cpu(cpus, cpu);
+	return n;
+}
+
+/* Read a sysfs cpu list ("0-3,8-11"). Returns -1 if missing. */
+static int read_cpu_list (const char* path, unsigned long* cpus)
+{
+	FILE* f = fopen(path, "re");
+	if (f == NULL)
+		return -1;
+
+	char line[4096];
+	int success = -1;
+	if (fgets(line, sizeof(line), f) != NULL)
+	{
+		char* end = strchr(line, '\n');
+		if (end != NULL)
+			*end = 0;
+		memset(cpus, 0, CPU_MASK_WORDS * sizeof(unsigned long));
+		success = parse_cpu_list(line, cpus);
+	}
+
+	fclose(f);
+	return success;
+}
+
+/* Index of the group with this exact cpu set, added if new. */
+static int add_Cpu_Group (Cpu_Group* groups, int* n, const unsigned long* cpus)
+{
+	for (int i=0; i < *n; i++)
+		if (memcmp(groups[i].cpus, cpus, sizeof(groups[i].cpus)) == 0)
+			return i;
+
+	if (*n == MAX_DOMAINS)
+		return -1;
+
+	memcpy(groups[*n].cpus, cpus, sizeof(groups[*n].cpus));
+	groups[*n].n_cpus = count_cpus(cpus);
+	return (*n)++;
+}
+
+/* Returns the number of L3 domains (0 if the topology is unknown). */
+int load_Topology ()
+{
+	if (topology.loaded)
+		return topology.n_l3;
+	topology.loaded = 1;
+
+	unsigned long online[CPU_MASK_WORDS];
+	if (read_cpu_list("/sys/devices/system/cpu/online", online) == -1)
+		return 0;
+
+	for (int cpu=0; cpu < MAX_CPUS; cpu++)
+	{
+		if (!has_cpu(online, cpu))
+			continue;
+
+		unsigned long l2[CPU_MASK_WORDS], l3[CPU_MASK_WORDS], cpus[CPU_MASK_WORDS];
+		int has_l2 = 0, has_l3 = 0;
+		char path[128];
+
+		for (int index=0; ; index++)
+		{
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+			FILE* f = fopen(path, "re");
+			if (f == NULL)
+				break;
+
+			int level = 0;
+			if (fscanf(f, "%d", &level) != 1)
+				level = 0;
+			fclose(f);
+
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+			if ((level == 2 || level == 3) && read_cpu_list(path, cpus) == 0)
+			{
+				if (level == 2)
+					memcpy(l2, cpus, sizeof(l2)), has_l2 = 1;
+				else
+					memcpy(l3, cpus, sizeof(l3)), has_l3 = 1;
+			}
+		}
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_cpus_list", cpu);
+		if (!has_l2 && read_cpu_list(path, l2) == 0)
+			has_l2 = 1;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/package_cpus_list", cpu);
+		if (!has_l3 && read_cpu_list(path, l3) == 0)
+			has_l3 = 1;
+
+		if (has_l2)
+			add_Cpu_Group(topology.l2, &topology.n_l2, l2);
+		if (has_l3)
+			add_Cpu_Group(topology.l3, &topology.n_l3, l3);
+	}
+
+	return topology.n_l3;
+}
+
+/* The least loaded L2 group inside L3 domain "domain" with at least "width" cpus (the
+   bigger one on a tie); or -1. load[]: processes already pinned to each group. */
+int find_L2_Group (int domain, int width, const int* load)
+{
+	int best = -1;
+
+	for (int i=0; i < topology.n_l2; i++)
+	{
+		Cpu_Group* g = &topology.l2[i];
+		if (g->n_cpus < width)
+			continue;
+
+		if (best != -1)
+		{
+			/* Per cpu: load[i] / n_cpus against the best's */
+			long mine = (long) load[i] * topology.l2[best].n_cpus, theirs = (long) load[best] * g->n_cpus;
+			if (mine > theirs || (mine == theirs && g->n_cpus <= topology.l2[best].n_cpus))
+				continue;
+		}
+
+		int inside = 1;
+		for (int w=0; w < CPU_MASK_WORDS && inside; w++)
+			inside = (g->cpus[w] & ~topology.l3[domain].cpus[w]) == 0;
+
+		if (inside)
+			best = i;
+	}
+
+	return best;
+}
+
+void print_Topology ()
+{
+	load_Topology();
+	printf("%d L3 domain(s), %d L2 group(s)\n", topology.n_l3, topology.n_l2);
+
+	for (int i=0; i < topology.n_l3; i++)
+	{
+		printf("  L3 %d:", i);
+		for (int cpu=0; cpu < MAX_CPUS; cpu++)
+			if (has_cpu(topology.l3[i].cpus, cpu))
+				printf(" %d", cpu);
+		printf("\n");
+	}
+}
+
+
+#endif /* TOPOLOGY_H */
+
+
+
+/* Test TOPOLOGY */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <sys/wait.h>		// waitpid
+#include "job.h"
+#include "events.h"
+
+/* Benchmark: each pipeline of the suite, unpinned vs placed (set -o placement) */
+static const char* pipeline_suite[] =
+{
+	"dd if=/dev/zero bs=64k count=8192 status=none | cat | wc -c",
+	"dd if=/dev/zero bs=64k count=8192 status=none | cat | cat | cat | wc -c",
+	"dd if=/dev/zero bs=4k count=65536 status=none | tr \\0 a | wc -l",
+	"seq 2000000 | sort -n | uniq | wc -l",
+};
+
+static long long time_Pipeline (const char* command, int placement)
+{
+	placement_option = placement;
+	strcpy(input_buffer, command);
+	Job* j = make_Job(set_tokens(" \t"));
+	j->foreground = 0;
+
+	long long start = get_monotonic_ns();
+	launch_Job(j);
+	for (Process* p = j->p; p != NULL; p = p->next)
+		waitpid(p->pid, NULL, 0);
+	long long elapsed = get_monotonic_ns() - start;
+
+	destroy_Job(j);
+	return elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+	int rounds = (argc > 1) ? atoi(argv[1]) : 3;
+
+	print_Topology();
+	freopen("/dev/null", "w", stdout); // the pipelines' own output
+
+	for (int i=0; i < sizeof(pipeline_suite) / sizeof(pipeline_suite[0]); i++)
+	{
+		long long best[2] = {0, 0};
+		for (int r=0; r < rounds; r++)
+			for (int placement=0; placement < 2; placement++)
+			{
+				long long t = time_Pipeline(pipeline_suite[i], placement);
+				if (best[placement] == 0 || t < best[placement])
+					best[placement] = t;
+			}
+
+		fprintf(stderr, "%-72s unpinned %7.1f ms  placed %7.1f ms  (%+.1f%%)\n", pipeline_suite[i],
+			best[0] / 1e6, best[1] / 1e6, 100.0 * (best[0] - best[1]) / best[1]);
+	}
+
+	return 0;
+}
+#endif
+/* Test TOPOLOGY */
@@ -0,0 +1,317 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <fcntl.h>			// pipe2, fcntl, O_NONBLOCK, O_CLOEXEC
+#include <unistd.h>			// read, write, close, getpid
+#include <stdio.h>			// fopen, fprintf, fputc
+#include <stdlib.h>			// calloc, malloc, free
+#include <string.h>			// strncpy
+#include <errno.h>			// EINTR, EAGAIN
+#include "events.h"
+
+#define TRACE_RING_SIZE 16384
+#define TRACE_DETAIL_SIZE 48
+
+
+/* set -o trace=file.json: the lifecycle of every job (fork, exec, setpgid, tcsetpgrp,
+   stop, continue, reap) and the shell's own prompt and parse phases, timestamped with
+   CLOCK_MONOTONIC into a ring allocated once when tracing is turned on (the oldest
+   events are overwritten when it wraps). The ring is written out as Chrome trace-event
+   JSON (chrome://tracing, ui.perfetto.dev) on "set +o trace" and when the shell exits:
+   each job is a process lane named after its command, each stage a thread in it.
+   Exec success is seen from the shell through a close-on-exec pipe: the child writes
+   its timestamp right before execvp, and EOF means the exec went through. */
+
+typedef enum
+{
+	Trace_Prompt,			// waiting for a line
+	Trace_Parse,			// tokenizing up to a launchable job
+	Trace_Launch,			// launch_Job
+	Trace_Fork,
+	Trace_Setpgid,
+	Trace_Tcsetpgrp,
+	Trace_Exec,
+	Trace_Exec_Failed,
+	Trace_Stop,
+	Trace_Continue,
+	Trace_Reap
+} Trace_Type;
+
+static const char* trace_names[] =
+{
+	"prompt", "parse", "launch", "fork", "setpgid", "tcsetpgrp", "exec", "exec failed", "stop", "continue", "reap"
+};
+
+typedef struct Trace_Event
+{
+	long long ns;
+	long long dur_ns;		// spans (prompt, parse, launch) only
+	pid_t pgid;				// lane: the job's process group, or the shell
+	pid_t pid;
+	Trace_Type type;
+	char detail[TRACE_DETAIL_SIZE];
+} Trace_Event;
+
+
+int trace_option = 0;
+char* trace_path = NULL;
+
+static struct
+{
+	Trace_Event* ring;
+	long long count;		// ever recorded: ring[count % TRACE_RING_SIZE] is next
+} trace;
+
+
+static void print_json_string (FILE* out, const char* str)
+{
+	fputc('"', out);
+	for (; *str != 0; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(out, "\\u%04x", *str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+
+/* Span from start_ns to now; pgid/pid 0 mean the shell. */
+void trace_Span (Trace_Type type, long long start_ns, pid_t pgid, pid_t pid, const char* detail)
+{
+	if (!trace_option || trace.ring == NULL)
+		return;
+
+	Trace_Event* e = &trace.ring[trace.count++ % TRACE_RING_SIZE];
+	e->ns = start_ns;
+	e->dur_ns = get_monotonic_ns() - start_ns;
+	e->pgid = pgid;
+	e->pid = pid;
+	e->type = type;
+	e->detail[0] = 0;
+	if (detail != NULL)
+		strncpy(e->detail, detail, TRACE_DETAIL_SIZE - 1)[TRACE_DETAIL_SIZE - 1] = 0;
+}
+
+/* Instant at ns (0: now) */
+void trace_Event (Trace_Type type, long long ns, pid_t pgid, pid_t pid)
+{
+	if (!trace_option || trace.ring == NULL)
+		return;
+
+	Trace_Event* e = &trace.ring[trace.count++ % TRACE_RING_SIZE];
+	e->ns = (ns != 0) ? ns : get_monotonic_ns();
+	e->dur_ns = 0;
+	e->pgid = pgid;
+	e->pid = pid;
+	e->type = type;
+	e->detail[0] = 0;
+}
+
+/* Write the ring out and empty it. Returns -1 (after printing why) on error. */
+int flush_Trace ()
+{
+	if (trace.ring == NULL || trace.count == 0 || trace_path == NULL)
+		return 0;
+
+	FILE* out = fopen(trace_path, "we");
+	if (out == NULL)
+	{
+		fprintf(stderr, "yash: trace: ");
+		perror(trace_path);
+		return -1;
+	}
+
+	pid_t shell = getpid();
+	long long first = (trace.count > TRACE_RING_SIZE) ? trace.count - TRACE_RING_SIZE : 0;
+
+	fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"yash\"}}", shell);
+
+	for (long long i = first; i < trace.count; i++)
+	{
+		Trace_Event* e = &trace.ring[i % TRACE_RING_SIZE];
+		pid_t pgid = e->pgid ? e->pgid : shell, pid = e->pid ? e->pid : pgid;
+
+		/* Name the job's lane after its command */
+		if (e->type == Trace_Launch)
+		{
+			fprintf(out, ",\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": ", pgid);
+			print_json_string(out, e->detail);
+			fprintf(out, "}}");
+		}
+
+		int span = (e->type <= Trace_Launch);
+		fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%s\", \"ts\": %.3f, ", trace_names[e->type],
+			(e->pgid == 0) ? "shell" : "job", span ? "X" : "i", e->ns / 1e3);
+		if (span)
+			fprintf(out, "\"dur\": %.3f, ", e->dur_ns / 1e3);
+		else
+			fprintf(out, "\"s\": \"t\", ");
+		fprintf(out, "\"pid\": %d, \"tid\": %d", pgid, pid);
+
+		if (e->detail[0] != 0)
+		{
+			fprintf(out, ", \"args\": {\"detail\": ");
+			print_json_string(out, e->detail);
+			fprintf(out, "}");
+		}
+		fprintf(out, "}");
+	}
+
+	fprintf(out, "\n]}\n");
+
+	if (first > 0)
+		fprintf(stderr, "yash: trace: ring wrapped, oldest %lld events dropped\n", first);
+
+	trace.count = 0;
+	if (fclose(out) == EOF)
+	{
+		fprintf(stderr, "yash: trace: ");
+		perror(trace_path);
+		return -1;
+	}
+	return 0;
+}
+
+/* set -o trace=file: flush to the old file (if any) on every change */
+static void trace_changed ()
+{
+	static char* flushed_path = NULL;
+
+	char* new_path = trace_path;
+	trace_path = flushed_path;
+	flush_Trace();
+	if (flushed_path != new_path)
+		free(flushed_path);
+	trace_path = flushed_path = new_path;
+
+	if (trace_option && trace_path == NULL)
+	{
+		fprintf(stderr, "yash: set: trace: expected trace=file\n");
+		trace_option = 0;
+	}
+
+	if (trace_option && trace.ring == NULL && (trace.ring = (Trace_Event*) calloc(TRACE_RING_SIZE, sizeof(Trace_Event))) == NULL)
+	{
+		perror("yash: trace: calloc");
+		trace_option = 0;
+	}
+}
+
+
+/* Exec notification: one per forked child while tracing */
+typedef struct Exec_Watch
+{
+	int fd;
+	pid_t pgid, pid;
+	long long ns[2];		// before execvp; again if it failed
+	size_t got;
+} Exec_Watch;
+
+/* Before fork: fds[1] goes to the child (see notify_Exec). Both -1 when not tracing. */
+void open_Exec_Notify (int fds[2])
+{
+	fds[0] = fds[1] = -1;
+	if (trace_option && trace.ring != NULL && pipe2(fds, O_CLOEXEC) == -1)
+		fds[0] = fds[1] = -1;
+}
+
+/* In the child, right before execvp (and after it, if it failed) */
+void notify_Exec (int fd)
+{
+	if (fd == -1)
+		return;
+
+	long long ns = get_monotonic_ns();
+	while (write(fd, &ns, sizeof(ns)) == -1 && errno == EINTR)
+		;
+}
+
+static void on_Exec_Notify (int fd, short revents, void* data)
+{
+	Exec_Watch* w = (Exec_Watch*) data;
+
+	ssize_t bytes;
+	while (w->got < sizeof(w->ns) && (bytes = read(fd, (char*) w->ns + w->got, sizeof(w->ns) - w->got)) > 0)
+		w->got += bytes;
+
+	char c;
+	if (read(fd, &c, 1) == -1 && (errno == EAGAIN || errno == EINTR))
+		return; // not exec'd (or exited) yet
+
+	/* EOF: the exec closed the pipe, or the child exited after a failed one */
+	if (w->got >= sizeof(long long))
+		trace_Event((w->got == sizeof(w->ns)) ? Trace_Exec_Failed : Trace_Exec, w->ns[0], w->pgid, w->pid);
+
+	remove_Event(fd);
+	close(fd);
+	free(w);
+}
+
+/* After fork, in the shell */
+void watch_Exec (int fds[2], pid_t pgid, pid_t pid)
+{
+	if (fds[0] == -1)
+		return;
+
+	close(fds[1]);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	Exec_Watch* w = (Exec_Watch*) calloc(1, sizeof(Exec_Watch));
+	if (w == NULL || add_Event(fds[0], POLLIN, on_Exec_Notify, w) == -1)
+	{
+		free(w);
+		close(fds[0]);
+		return;
+	}
+
+	w->fd = fds[0];
+	w->pgid = pgid;
+	w->pid = pid;
+}
+
+
+#endif /* TRACE_H */
+
+
+
+/* Test TRACE */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <sys/wait.h>		// waitpid
+
+int main(int argc, char* argv[])
+{
+	trace_option = 1;
+	trace_path = strdup("/dev/stdout");
+	trace_changed();
+
+	long long start = get_monotonic_ns();
+	int fds[2];
+	open_Exec_Notify(fds);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		notify_Exec(fds[1]);
+		execlp("true", "true", NULL);
+		notify_Exec(fds[1]);
+		_exit(1);
+	}
+	trace_Event(Trace_Fork, 0, pid, pid);
+	watch_Exec(fds, pid, pid);
+
+	while (event_count > 0)
+		wait_Events(-1, -1);
+	waitpid(pid, NULL, 0);
+	trace_Event(Trace_Reap, 0, pid, pid);
+	trace_Span(Trace_Launch, start, pid, 0, "true \"quoted\"");
+
+	return flush_Trace() == -1;
+}
+#endif
+/* Test TRACE */
@@ -0,0 +1,296 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <sys/timerfd.h>	// timerfd_create, timerfd_settime
+#include <signal.h>			// kill, SIGTERM, SIGKILL
+#include <stdio.h>			// fopen, fscanf, fprintf
+#include <stdlib.h>			// malloc, free
+#include <string.h>			// strncmp
+#include <unistd.h>			// read, close, sysconf
+#include "job.h"
+#include "events.h"
+#include "parse_tokens.h"
+#include "faces.h"
+
+#define WATCHDOG_SAMPLE_MS 1000
+#define WATCHDOG_GRACE_MS 5000
+
+
+/* Per-job limits enforced by the shell itself ("cmd &! timeout=30s rss=2G stall=60s"):
+   a timerfd for the wall-clock deadline, and a sampling timerfd that reads
+   /proc/<pid>/statm (resident set) and /proc/<pid>/io (bytes written) of each process.
+   A tripped limit sends SIGTERM to the job's pgid, then SIGKILL after the grace period. */
+
+typedef struct Watchdog
+{
+	Job* j;
+	long long timeout_ms;
+	long long rss_limit;		// bytes
+	long long stall_ms;
+	long long grace_ms;
+	int deadline_fd;			// one-shot: timeout, then SIGKILL escalation
+	int sample_fd;				// periodic: rss and stall
+	long long last_written;		// wchar total at last progress
+	long long last_progress_ns;
+	struct Watchdog* next;
+} Watchdog;
+
+
+static Watchdog* watchdog_list = NULL;
+
+
+static int arm_timer (int fd, long long ms, int periodic)
+{
+	struct itimerspec t = {{0, 0}, {ms / 1000, (ms % 1000) * 1000000}};
+	if (periodic)
+		t.it_interval = t.it_value;
+
+	return timerfd_settime(fd, 0, &t, NULL);
+}
+
+static long long read_proc_value (pid_t pid, const char* file, const char* key)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+
+	FILE* f = fopen(path, "re");
+	if (f == NULL)
+		return 0;
+
+	long long value = 0;
+	if (key == NULL) // statm: "size resident ..." in pages
+	{
+		long long size;
+		if (fscanf(f, "%lld %lld", &size, &value) == 2)
+			value *= sysconf(_SC_PAGESIZE);
+	}
+	else
+	{
+		char line[128];
+		size_t len = strlen(key);
+		while (fgets(line, sizeof(line), f) != NULL)
+			if (strncmp(line, key, len) == 0)
+			{
+				value = atoll(line + len);
+				break;
+			}
+	}
+
+	fclose(f);
+	return value;
+}
+
+void stop_Watchdog (Job* j)
+{
+	Watchdog** link = &watchdog_list;
+	while (*link != NULL && (*link)->j != j)
+		link = &(*link)->next;
+
+	Watchdog* w = *link;
+	if (w == NULL)
+		return;
+	*link = w->next;
+
+	remove_Event(w->deadline_fd);
+	close(w->deadline_fd);
+	if (w->sample_fd != -1)
+	{
+		remove_Event(w->sample_fd);
+		close(w->sample_fd);
+	}
+	free(w);
+}
+
+static void trip_Watchdog (Watchdog* w, const char* reason)
+{
+	if (w->j->reason != NULL)
+		return; // already escalating
+
+	w->j->reason = reason;
+	w->j->foreground = 0; // report it at the next prompt
+
+	if (w->j->pgid > 0) // kill(0) would be the shell's own group
+	{
+		kill(- w->j->pgid, SIGTERM);
+		kill(- w->j->pgid, SIGCONT);
+	}
+	arm_timer(w->deadline_fd, w->grace_ms, 0);
+}
+
+static void on_deadline (int fd, short revents, void* data)
+{
+	Watchdog* w = (Watchdog*) data;
+	unsigned long long expirations;
+	read(fd, &expirations, sizeof(expirations));
+
+	if (!is_Alive(w->j))
+		stop_Watchdog(w->j);
+	else if (w->j->reason == NULL)
+		trip_Watchdog(w, "timeout");
+	else if (w->j->pgid > 0)
+		kill(- w->j->pgid, SIGKILL); // grace period is over
+}
+
+static void on_sample (int fd, short revents, void* data)
+{
+	Watchdog* w = (Watchdog*) data;
+	unsigned long long expirations;
+	read(fd, &expirations, sizeof(expirations));
+
+	if (!is_Alive(w->j))
+	{
+		stop_Watchdog(w->j);
+		return;
+	}
+
+	long long rss = 0, written = 0;
+	for (Process* p = w->j->p; p != NULL; p = p->next)
+	{
+		if (p->state == Done_State || p->state == Error_State)
+			continue;
+		if (w->rss_limit)
+			rss += read_proc_value(p->pid, "statm", NULL);
+		if (w->stall_ms)
+			written += read_proc_value(p->pid, "io", "wchar: ");
+	}
+
+	long long now = get_monotonic_ns();
+	if (written != w->last_written)
+	{
+		w->last_written = written;
+		w->last_progress_ns = now;
+	}
+
+	if (w->rss_limit && rss > w->rss_limit)
+		trip_Watchdog(w, "rss");
+	else if (w->stall_ms && (now - w->last_progress_ns) / 1000000 >= w->stall_ms)
+		trip_Watchdog(w, "stall");
+}
+
+static int is_option (const char* option, size_t len, const char* key)
+{
+	return len == strlen(key) && strncmp(option, key, len) == 0;
+}
+
+/* Options: timeout=<duration> rss=<size> stall=<duration> grace=<duration>
+   Returns NULL (after printing why) if an option is malformed. */
+Watchdog* make_Watchdog (char** options)
+{
+	Watchdog* w = (Watchdog*) calloc(1, sizeof(Watchdog));
+	if (w == NULL)
+	{
+		perror(flip_table " yash: make_Watchdog: calloc");
+		return NULL;
+	}
+
+	w->grace_ms = WATCHDOG_GRACE_MS;
+	w->deadline_fd = -1;
+	w->sample_fd = -1;
+
+	for (; *options != NULL; options++)
+	{
+		char* value = strchr(*options, '=');
+		long long* field = NULL;
+		int is_size = 0;
+
+		if (value != NULL)
+		{
+			size_t len = value++ - *options;
+			if (is_option(*options, len, "timeout"))
+				field = &w->timeout_ms;
+			else if (is_option(*options, len, "rss"))
+				field = &w->rss_limit, is_size = 1;
+			else if (is_option(*options, len, "stall"))
+				field = &w->stall_ms;
+			else if (is_option(*options, len, "grace"))
+				field = &w->grace_ms;
+		}
+
+		if (field == NULL || (*field = is_size ? parse_size(value) : parse_duration_ms(value)) <= 0)
+		{
+			fprintf(stderr, "yash: &!: %s: expected timeout=, rss=, stall= or grace=\n", *options);
+			free(w);
+			return NULL;
+		}
+	}
+
+	return w;
+}
+
+/* Called right after launch_Job. Takes ownership of w. */
+int start_Watchdog (Watchdog* w, Job* j)
+{
+	w->j = j;
+
+	w->deadline_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+	if (w->deadline_fd == -1)
+	{
+		perror(flip_table " yash: timerfd_create");
+		free(w);
+		return -1;
+	}
+	if (w->timeout_ms)
+		arm_timer(w->deadline_fd, w->timeout_ms, 0);
+	add_Event(w->deadline_fd, POLLIN, on_deadline, w);
+
+	if (w->rss_limit || w->stall_ms)
+	{
+		long long interval = WATCHDOG_SAMPLE_MS;
+		if (w->stall_ms && w->stall_ms / 4 < interval)
+			interval = (w->stall_ms / 4) ? w->stall_ms / 4 : 1;
+
+		w->sample_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (w->sample_fd != -1)
+		{
+			arm_timer(w->sample_fd, interval, 1);
+			add_Event(w->sample_fd, POLLIN, on_sample, w);
+		}
+	}
+
+	w->last_written = -1;
+	w->last_progress_ns = get_monotonic_ns();
+	w->next = watchdog_list;
+	watchdog_list = w;
+
+	return 0;
+}
+
+
+#endif /* WATCHDOG_H */
+
+
+
+/* Test WATCHDOG */
+#if __INCLUDE_LEVEL__ == 0 && defined __INCLUDE_LEVEL__
+#include <stdio.h>			// printf
+#include <sys/wait.h>		// waitpid
+
+int main(int argc, char* argv[])
+{
+	char line[] = "sleep 10 &! timeout=300ms grace=100ms";
+	strcpy(input_buffer, line);
+	char** tokens = set_tokens(" \t");
+	Watchdog* w = make_Watchdog(set_watchdog_start(tokens));
+	if (w == NULL)
+		return 1;
+
+	Job* j = make_Job(tokens);
+	launch_Job(j);
+	if (start_Watchdog(w, j) == -1)
+		return 1;
+
+	long long start = get_monotonic_ns();
+	while (watchdog_list != NULL && j->reason == NULL)
+		wait_Events(-1, -1);
+
+	int status;
+	waitpid(j->pgid, &status, 0);
+	printf("%s: %s after %lld ms (signal %d)\n", j->command, j->reason,
+		(get_monotonic_ns() - start) / 1000000, WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+
+	stop_Watchdog(j);
+	destroy_Job(j);
+	return 0;
+}
+#endif
+/* Test WATCHDOG */
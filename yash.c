@@ -1,125 +1,320 @@
-#include <signal.h>			// kill, signal
-#include <stdio.h>			// printf, fflush, setvbuf, perror
-#include <unistd.h>			// isatty, setpgid, tcgetpgrp, tcsetpgrp, getpgid, getpid
-#include <stdlib.h>			// exit, atexit
-#include "tokenize.h"
-#include "job.h"
-#include "job_control.h"
-#include "faces.h"
-#include <string.h>			// strcmp
-
-
-void exit_handler ()
-{
-	for (Job* j = current_Job; j != NULL; j = j->next)
-		kill (- j->pgid, SIGHUP);
-	destroy_Job(current_Job);
-	printf("exit\n");
-}
-
-
-void signal_handler (int signo)
-{
-	switch(signo)
-	{
-		case SIGINT:
-		case SIGTSTP:
-			printf("\n# ");
-			fflush(stdout);
-	}
-}
-
-
-int prompt ()
-{
-	print_Jobs(0);
-	tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes); // restore shell terminal modes
-	tcsetpgrp(STDIN_FILENO, shell_pid);
-
-	printf("# ");
-	return read_line(stdin) != NULL;
-}
-
-
-int main(int argc, char* argv[])
-{
-	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
-
-
-	if (argc == 2 && strcmp(argv[1], "pikachu") == 0)
-		fprintf(stderr,
-			"\n"
-			"         YASH!"
-			pikachu "\n"
-			"(...and his best friend ^)\n\n"
-		);
-
-
-	if (!isatty(STDIN_FILENO))
-	{
-		fprintf(stderr, flip_table " yash: abort reason: Job control won't work because yash is not executing from a tty\n");
-		return 0;
-	}
-
-
-	shell_pid = getpid();
-	if (setpgid(0,0) == -1)
-	{
-		perror (flip_table " yash: abort reason: Couldn't put yash in its own process group");
-		return 0;
-	}
-	// printf("My pid: %d, pgid: %d\n", getpid(), getpgid(0));
-
-
-	while (tcgetpgrp (STDIN_FILENO) != getpgid(0))
-		kill (- getpgid(0), SIGTTIN);
-
-
-	if (tcsetpgrp(STDIN_FILENO, getpid()) == -1)
-	{
-		perror(flip_table " yash: abort reason: Couldn't obtain control of the terminal");
-		return 0;
-	}
-
-
-	tcgetattr (STDIN_FILENO, &shell_tmodes);
-
-
-	atexit(exit_handler);
-
-
-	if (signal(SIGINT, signal_handler) == SIG_ERR)	perror(blank_face " yash: signal");
-	if (signal(SIGTSTP, signal_handler) == SIG_ERR) perror(blank_face " yash: signal");
-
-	if (signal (SIGCHLD, SIG_DFL) == SIG_ERR)		perror(blank_face " yash: signal");
-
-	if (signal (SIGQUIT, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
-	if (signal (SIGTTIN, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
-	if (signal (SIGTTOU, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
-
-
-	Job* j = NULL;
-	while (prompt())
-	{
-		char** tokens = set_tokens(" \t");
-
-		if (no_tokens(tokens))
-			continue;
-
-		if (launch_builtin(tokens))
-			continue;
-
-		j = make_Job(tokens);
-		if (j == NULL)
-			continue;
-		j->next = current_Job;
-		current_Job = j;
-
-		launch_Job(current_Job);
-		if (current_Job->foreground)
-			wait_Job(current_Job);
-	}
-
-
-	return 0;
-}
+#include <signal.h>			// kill, signal
+#include <stdio.h>			// printf, fflush, setvbuf, perror
+#include <unistd.h>			// isatty, setpgid, tcgetpgrp, tcsetpgrp, getpgid, getpgrp, getpid
+#include <stdlib.h>			// exit, atexit
+#include "tokenize.h"
+#include "job.h"
+#include "job_control.h"
+#include "builtins.h"
+#include "script_profile.h"
+#include "budget.h"
+#include "faces.h"
+#include <string.h>			// strcmp
+#include <errno.h>			// errno, EINTR
+
+
+void exit_handler ()
+{
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		if (j->pgid != 0)
+			kill (- j->pgid, SIGHUP);
+	destroy_Job(current_Job);
+	flush_Trace();
+	live_option = 0;
+	update_Live();
+	finish_Script_Profile();
+	if (interactive)
+		printf("exit\n");
+}
+
+
+void signal_handler (int signo)
+{
+	switch(signo)
+	{
+		case SIGINT:
+			interrupted = 1;
+		case SIGTSTP:
+			printf("\n# ");
+			fflush(stdout);
+	}
+}
+
+/* Script mode: every job has a group of its own, so a ^C meant for the script (or a
+   kill of the shell) would leave its foreground job running. Passed on to that job;
+   the script stops once it is gone. */
+volatile sig_atomic_t script_signal = 0;
+
+void script_signal_handler (int signo)
+{
+	int saved_errno = errno;
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		if (j->foreground && j->pgid != 0)
+		{
+			kill(- j->pgid, signo);
+			kill(- j->pgid, SIGCONT);
+		}
+	script_signal = signo;
+	interrupted = 1;
+	errno = saved_errno;
+}
+
+
+int prompt ()
+{
+	report_Budget(); // make yash-budget: what the last line cost
+	print_Jobs(0);
+	update_Live();
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes); // restore shell terminal modes
+	tcsetpgrp(STDIN_FILENO, shell_pid);
+
+	printf("# ");
+	fflush(stdout);
+
+	long long start = get_monotonic_ns();
+	int ready;
+	while ((ready = wait_Events(-1, STDIN_FILENO)) == 0 || (ready == -1 && errno == EINTR))
+		; // keep serving background events until a line is typed
+
+	int got_line = read_line(stdin) != NULL;
+	trace_Span(Trace_Prompt, start, 0, 0, NULL);
+	return got_line;
+}
+
+
+/* One line of input, already in input_buffer: a builtin, or a job that is launched
+   (and waited for, in the foreground). line: where it is in a script, or 0. Returns
+   early on anything that isn't a job: run_line sets the phase back after it. */
+static void launch_line (int line)
+{
+	long long parse_start = get_monotonic_ns();
+	set_Phase(Phase_Parse);
+	char** tokens = set_tokens(" \t");
+
+	if (no_tokens(tokens))
+		return;
+
+	set_Phase(Phase_Builtin);
+	if (launch_builtin(tokens))
+		return;
+	set_Phase(Phase_Parse);
+
+	int json;
+	int timed = get_time_prefix(tokens, &json);
+	tokens += timed;
+	if (timed && (no_tokens(tokens) || get_token_index((char**) special, tokens[0]) != -1))
+	{
+		/* Builtins run inside the shell: there is no process to time */
+		if (!no_tokens(tokens))
+			fprintf(stderr, "yash: time: %s: can't time a shell builtin\n", tokens[0]);
+		fprintf(stderr, "yash: time: usage: time [-j] cmd ...\n");
+		return;
+	}
+
+	Limits* l = NULL;
+	char** command = set_limit_start(tokens);
+	if (command != tokens)
+	{
+		if (no_tokens(command))
+		{
+			fprintf(stderr, "yash: limit: usage: limit key=value ... -- cmd ...\n");
+			return;
+		}
+		if ((l = make_Limits(tokens+1)) == NULL)
+			return;
+		tokens = command;
+	}
+
+	Watchdog* w = NULL;
+	char** watch_options = set_watchdog_start(tokens);
+	if (watch_options != NULL && (w = make_Watchdog(watch_options)) == NULL)
+	{
+		free(l);
+		return;
+	}
+
+	Job* j = make_Job(tokens);
+	if (j == NULL)
+	{
+		free(l);
+		free(w);
+		return;
+	}
+	j->limits = l;
+	j->timed = !timed ? No_Time : json ? Json_Time : Human_Time;
+	j->line = line;
+	j->next = current_Job;
+	current_Job = j;
+	trace_Span(Trace_Parse, parse_start, 0, 0, j->command);
+	record_Stat(Parse_Stat, get_monotonic_ns() - parse_start);
+
+	set_Phase(Phase_Launch);
+	int launched = launch_Job(current_Job) == 0;
+	record_Stat(Launch_Stat, get_monotonic_ns() - parse_start);
+	if (!launched)
+	{
+		abort_Launch(current_Job);
+		free(w); // nothing to watch
+	}
+	else if (w != NULL)
+		start_Watchdog(w, current_Job);
+	set_Phase(Phase_Wait);
+	if (current_Job->foreground)
+		wait_Job(current_Job);
+}
+
+void run_line (int line)
+{
+	launch_line(line);
+	set_Phase(Phase_Other);
+}
+
+/* Finished jobs go to the profile, then out of the job table */
+static void finish_script_Jobs ()
+{
+	update_Jobs();
+	for (Job* j = current_Job; j != NULL; j = j->next)
+		if (j->state == Done_State || j->state == Error_State)
+			record_Script_Job(j);
+	clean_Jobs(0);
+}
+
+/* yash [--profile=out] script: every line run as if typed at the prompt. Lines
+   starting with '#' are comments. Foreground jobs get the terminal only if the script
+   was started in its foreground (then a ^C reaches the job alone, and the script goes
+   on). At the end the shell waits for its background jobs. */
+int run_script (const char* path, const char* profile_path)
+{
+	FILE* script = fopen(path, "re");
+	if (script == NULL)
+	{
+		fprintf(stderr, "yash: ");
+		perror(path);
+		return 127;
+	}
+
+	interactive = 0;
+	shell_pid = getpid();
+	script_terminal = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+	if (script_terminal)
+		tcgetattr(STDIN_FILENO, &shell_tmodes);
+	atexit(exit_handler); // writes the profile, even after "exit"
+
+	if (signal(SIGINT, script_signal_handler) == SIG_ERR)	perror(blank_face " yash: signal");
+	if (signal(SIGTERM, script_signal_handler) == SIG_ERR)	perror(blank_face " yash: signal");
+	if (signal(SIGHUP, script_signal_handler) == SIG_ERR)	perror(blank_face " yash: signal");
+	if (signal (SIGPIPE, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal"); // relays (|>) get EPIPE instead
+	if (signal (SIGTTOU, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal"); // taking the terminal back
+	watch_Children();
+
+	if (profile_path != NULL && start_Script_Profile(profile_path, path) == -1)
+	{
+		fclose(script);
+		return 1;
+	}
+
+	for (int line = 1; script_signal == 0 && read_line(script) != NULL; line++)
+	{
+		if (input_buffer[0] == '#')
+			continue;
+		enter_Line(line, input_buffer);
+		run_line(line);
+		if (script_terminal)
+		{
+			tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+			tcsetpgrp(STDIN_FILENO, getpgrp());
+		}
+		finish_script_Jobs();
+	}
+	fclose(script);
+
+	if (script_signal != 0)
+		return 128 + script_signal; // exit_handler hangs up on the background jobs
+
+	char* all[] = {NULL};
+	wait_builtin(all);
+	finish_script_Jobs();
+
+	return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+
+	if (argc == 2 && strcmp(argv[1], "pikachu") == 0)
+		fprintf(stderr,
+			"\n"
+			"         YASH!"
+			pikachu "\n"
+			"(...and his best friend ^)\n\n"
+		);
+
+
+	/* yash [--profile=out] script */
+	const char* profile_path = NULL;
+	int arg = 1;
+	if (arg < argc && strncmp(argv[arg], "--profile=", 10) == 0)
+		profile_path = argv[arg++] + 10;
+	if (arg < argc && !(argc == 2 && strcmp(argv[1], "pikachu") == 0))
+		return run_script(argv[arg], profile_path);
+	if (profile_path != NULL)
+	{
+		fprintf(stderr, "yash: usage: yash [--profile=out] script\n");
+		return 2;
+	}
+
+
+	if (!isatty(STDIN_FILENO))
+	{
+		fprintf(stderr, flip_table " yash: abort reason: Job control won't work because yash is not executing from a tty\n");
+		return 0;
+	}
+
+
+	shell_pid = getpid();
+	if (setpgid(0,0) == -1)
+	{
+		perror (flip_table " yash: abort reason: Couldn't put yash in its own process group");
+		return 0;
+	}
+	// printf("My pid: %d, pgid: %d\n", getpid(), getpgid(0));
+
+
+	while (tcgetpgrp (STDIN_FILENO) != getpgid(0))
+		kill (- getpgid(0), SIGTTIN);
+
+
+	if (tcsetpgrp(STDIN_FILENO, getpid()) == -1)
+	{
+		perror(flip_table " yash: abort reason: Couldn't obtain control of the terminal");
+		return 0;
+	}
+
+
+	tcgetattr (STDIN_FILENO, &shell_tmodes);
+
+
+	atexit(exit_handler);
+
+
+	if (signal(SIGINT, signal_handler) == SIG_ERR)	perror(blank_face " yash: signal");
+	if (signal(SIGTSTP, signal_handler) == SIG_ERR) perror(blank_face " yash: signal");
+
+	if (signal (SIGCHLD, SIG_DFL) == SIG_ERR)		perror(blank_face " yash: signal");
+
+	if (signal (SIGQUIT, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
+	if (signal (SIGPIPE, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal"); // relays (|>) get EPIPE instead
+	if (signal (SIGTTIN, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
+	if (signal (SIGTTOU, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
+
+	watch_Children();
+
+
+	while (prompt())
+		run_line(0);
+
+	return 0;
+}
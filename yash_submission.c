@@ -8,6 +8,7 @@ ls
 #include "tokenize.h"
 #include "job.h"
 #include "job_control.h"
+#include "builtins.h"
 #include "faces.h"
 
 
@@ -16,6 +17,9 @@ void exit_handler ()
 	for (Job* j = current_Job; j != NULL; j = j->next)
 		kill (- j->pgid, SIGHUP);
 	destroy_Job(current_Job);
+	flush_Trace();
+	live_option = 0;
+	update_Live();
 	printf("exit\n");
 }
 
@@ -35,6 +39,7 @@ void signal_handler (int signo)
 int prompt ()
 {
 	print_Jobs(0);
+	update_Live();
 	tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes); // restore shell terminal modes
 	tcsetpgrp(STDIN_FILENO, shell_pid);
 
@@ -95,6 +100,7 @@ int main(int argc, char* argv[])
 	if (signal (SIGCHLD, SIG_DFL) == SIG_ERR)		perror(blank_face " yash: signal");
 
 	if (signal (SIGQUIT, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
+	if (signal (SIGPIPE, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal"); // relays (|>) get EPIPE instead
 	if (signal (SIGTTIN, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
 	if (signal (SIGTTOU, SIG_IGN) == SIG_ERR)		perror(blank_face " yash: signal");
 
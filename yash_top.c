@@ -0,0 +1,299 @@
+#include <stdio.h>			// printf, fprintf, fopen, rename
+#include <stdlib.h>			// atoi, atof
+#include <string.h>			// strcmp, strncmp
+#include <unistd.h>			// usleep
+#include <signal.h>			// kill
+#include <errno.h>			// ESRCH
+#include <dirent.h>			// opendir, readdir
+#include <time.h>			// clock_gettime
+#include <stddef.h>			// offsetof
+#include "live.h"
+
+#define MAX_SHELLS 256
+
+
+/* yash-top [-p pid] [-d seconds] [-n iterations] [--prom file]
+
+   Reads the segments of shells running with "set -o live" (live.h): every
+   /dev/shm/yash.<pid> whose shell is still alive, or just -p's. Prints their
+   counters, latency percentiles and job tables every -d seconds (default 1), -n
+   times (default: until killed). With --prom the same numbers are also written to
+   file in the Prometheus text format, each time through a temporary file renamed
+   over it, so a node_exporter textfile collector never sees half of one. */
+
+
+static int find_Shells (pid_t* pids, int max)
+{
+	DIR* dir = opendir("/dev/shm");
+	if (dir == NULL)
+	{
+		perror("yash-top: /dev/shm");
+		return 0;
+	}
+
+	int n = 0;
+	struct dirent* entry;
+	while (n < max && (entry = readdir(dir)) != NULL)
+	{
+		if (strncmp(entry->d_name, "yash.", 5) != 0)
+			continue;
+
+		pid_t pid = atoi(entry->d_name + 5);
+		if (pid <= 0 || (kill(pid, 0) == -1 && errno == ESRCH))
+			continue; // a shell that died without removing it
+
+		pids[n++] = pid;
+	}
+
+	closedir(dir);
+	return n;
+}
+
+static long long get_now_ns ()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static const char* format_ns (unsigned long long ns, char* buffer, size_t size)
+{
+	if (ns >= 1000000000ULL)
+		snprintf(buffer, size, "%.2fs", ns / 1e9);
+	else if (ns >= 1000000)
+		snprintf(buffer, size, "%.2fms", ns / 1e6);
+	else if (ns >= 1000)
+		snprintf(buffer, size, "%.1fus", ns / 1e3);
+	else
+		snprintf(buffer, size, "%lluns", ns);
+	return buffer;
+}
+
+
+static void print_Segment (const Live_Segment* l)
+{
+	printf("yash %d: %llu jobs launched, %llu finished, %llu processes forked, %llu reaped, shell cpu %.2fs, updated %.1fs ago\n",
+		l->shell_pid, l->jobs_launched, l->jobs_finished, l->processes_forked, l->processes_reaped,
+		l->shell_cpu_s, (get_now_ns() - l->updated_ns) / 1e9);
+
+	printf("  %-10s %8s %9s %9s %9s %9s\n", "", "count", "p50", "p90", "p99", "max");
+	for (int s=0; s < l->n_stats && s < LIVE_MAX_STATS; s++)
+	{
+		const Live_Stat* st = &l->stats[s];
+		char buffer[4][16];
+		printf("  %-10.16s %8llu", st->name, st->count);
+		if (st->count > 0)
+			printf(" %9s %9s %9s %9s", format_ns(st->p50_ns, buffer[0], sizeof(buffer[0])),
+				format_ns(st->p90_ns, buffer[1], sizeof(buffer[1])), format_ns(st->p99_ns, buffer[2], sizeof(buffer[2])),
+				format_ns(st->max_ns, buffer[3], sizeof(buffer[3])));
+		printf("\n");
+	}
+
+	if (l->n_jobs == 0)
+		return;
+
+	printf("  %4s %7s  %-8s %6s %9s %9s %9s  %s\n", "job", "pgid", "state", "stages", "cpu", "rss", "runtime", "command");
+	for (int i=0; i < l->n_jobs && i < LIVE_MAX_JOBS; i++)
+	{
+		const Live_Job* j = &l->jobs[i];
+		printf("  %4d %7d  %-8.12s %6d %8.2fs %7lldKB %8.1fs  %.*s%s\n", j->index, j->pgid, j->state, j->stages,
+			j->cpu_s, j->rss_kb, j->runtime_s, LIVE_COMMAND_SIZE, j->command, j->foreground ? "" : " &");
+	}
+}
+
+
+/* Label value: backslash, double quote and newline escaped */
+static void print_prom_label (FILE* out, const char* str, size_t size)
+{
+	for (size_t i=0; i < size && str[i] != 0; i++)
+		if (str[i] == '\\' || str[i] == '"')
+			fprintf(out, "\\%c", str[i]);
+		else if (str[i] == '\n')
+			fprintf(out, "\\n");
+		else
+			fputc(str[i], out);
+}
+
+static void print_prom_header (FILE* out, const char* name, const char* type, const char* help)
+{
+	fprintf(out, "# HELP yash_%s %s\n# TYPE yash_%s %s\n", name, help, name, type);
+}
+
+static void write_Prometheus (FILE* out, const Live_Segment* segments, int n)
+{
+	static const struct
+	{
+		const char* name;
+		size_t offset;
+		const char* help;
+	} counters[] =
+	{
+		{"jobs_launched_total", offsetof(Live_Segment, jobs_launched), "Jobs launched by the shell."},
+		{"jobs_finished_total", offsetof(Live_Segment, jobs_finished), "Jobs whose last stage was reaped."},
+		{"processes_forked_total", offsetof(Live_Segment, processes_forked), "Processes forked for jobs."},
+		{"processes_reaped_total", offsetof(Live_Segment, processes_reaped), "Processes reaped after exiting."},
+	};
+
+	for (int c=0; c < (int) (sizeof(counters) / sizeof(counters[0])); c++)
+	{
+		print_prom_header(out, counters[c].name, "counter", counters[c].help);
+		for (int i=0; i < n; i++)
+			fprintf(out, "yash_%s{shell_pid=\"%d\"} %llu\n", counters[c].name, segments[i].shell_pid,
+				*(const unsigned long long*) ((const char*) &segments[i] + counters[c].offset));
+	}
+
+	print_prom_header(out, "cpu_seconds_total", "counter", "CPU time of the shell itself.");
+	for (int i=0; i < n; i++)
+		fprintf(out, "yash_cpu_seconds_total{shell_pid=\"%d\"} %.6f\n", segments[i].shell_pid, segments[i].shell_cpu_s);
+
+	print_prom_header(out, "jobs", "gauge", "Jobs in the shell's job table.");
+	for (int i=0; i < n; i++)
+		fprintf(out, "yash_jobs{shell_pid=\"%d\"} %d\n", segments[i].shell_pid, segments[i].n_jobs);
+
+	print_prom_header(out, "latency_seconds", "summary", "Shell overhead: spawn, parse, launch, job and reap lag.");
+	for (int i=0; i < n; i++)
+		for (int s=0; s < segments[i].n_stats && s < LIVE_MAX_STATS; s++)
+		{
+			const Live_Stat* st = &segments[i].stats[s];
+			char stat[sizeof(st->name)];
+			for (size_t c=0; c < sizeof(stat); c++)
+				stat[c] = (st->name[c] == ' ') ? '_' : st->name[c];
+			stat[sizeof(stat) - 1] = 0;
+
+			const double quantiles[] = {0.5, 0.9, 0.99, 1};
+			const unsigned long long values[] = {st->p50_ns, st->p90_ns, st->p99_ns, st->max_ns};
+			for (int q=0; st->count > 0 && q < 4; q++)
+				fprintf(out, "yash_latency_seconds{shell_pid=\"%d\",stat=\"%s\",quantile=\"%g\"} %.9f\n",
+					segments[i].shell_pid, stat, quantiles[q], values[q] / 1e9);
+			fprintf(out, "yash_latency_seconds_sum{shell_pid=\"%d\",stat=\"%s\"} %.9f\n", segments[i].shell_pid, stat, st->sum_ns / 1e9);
+			fprintf(out, "yash_latency_seconds_count{shell_pid=\"%d\",stat=\"%s\"} %llu\n", segments[i].shell_pid, stat, st->count);
+		}
+
+	static const char* job_metrics[][3] =
+	{
+		{"job_cpu_seconds", "gauge", "CPU time of a job, every stage."},
+		{"job_rss_bytes", "gauge", "Resident memory of a job, every stage (peak once reaped)."},
+		{"job_runtime_seconds", "gauge", "Wall time since the job was launched."},
+	};
+	for (int m=0; m < 3; m++)
+	{
+		print_prom_header(out, job_metrics[m][0], job_metrics[m][1], job_metrics[m][2]);
+		for (int i=0; i < n; i++)
+			for (int k=0; k < segments[i].n_jobs && k < LIVE_MAX_JOBS; k++)
+			{
+				const Live_Job* j = &segments[i].jobs[k];
+				double value = (m == 0) ? j->cpu_s : (m == 1) ? j->rss_kb * 1024.0 : j->runtime_s;
+
+				fprintf(out, "yash_%s{shell_pid=\"%d\",job=\"%d\",pgid=\"%d\",state=\"", job_metrics[m][0], segments[i].shell_pid, j->index, j->pgid);
+				print_prom_label(out, j->state, sizeof(j->state));
+				fprintf(out, "\",command=\"");
+				print_prom_label(out, j->command, sizeof(j->command));
+				fprintf(out, "\"} %.10g\n", value);
+			}
+	}
+}
+
+/* Returns -1 (after printing why) if the file couldn't be replaced */
+static int save_Prometheus (const char* path, const Live_Segment* segments, int n)
+{
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	FILE* out = fopen(tmp, "we");
+	if (out == NULL)
+	{
+		fprintf(stderr, "yash-top: ");
+		perror(tmp);
+		return -1;
+	}
+
+	write_Prometheus(out, segments, n);
+
+	if (fclose(out) == EOF || rename(tmp, path) == -1)
+	{
+		fprintf(stderr, "yash-top: ");
+		perror(path);
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int main (int argc, char* argv[])
+{
+	setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+
+	pid_t only = 0;
+	double delay = 1;
+	int iterations = -1;
+	const char* prom = NULL;
+
+	for (int i=1; i < argc; i++)
+		if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+			only = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-d") == 0 && i+1 < argc)
+			delay = atof(argv[++i]);
+		else if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+			iterations = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--prom") == 0 && i+1 < argc)
+			prom = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: yash-top [-p pid] [-d seconds] [-n iterations] [--prom file]\n");
+			return 2;
+		}
+
+	if (delay <= 0 || iterations == 0)
+	{
+		fprintf(stderr, "usage: yash-top [-p pid] [-d seconds] [-n iterations] [--prom file]\n");
+		return 2;
+	}
+
+	static Live_Segment segments[MAX_SHELLS];
+	int status = 0;
+
+	for (int round = 0; iterations < 0 || round < iterations; round++)
+	{
+		if (round > 0)
+			usleep(delay * 1e6);
+
+		pid_t pids[MAX_SHELLS];
+		int found = only ? 1 : find_Shells(pids, MAX_SHELLS), n = 0;
+		if (only)
+			pids[0] = only;
+
+		for (int i=0; i < found; i++)
+		{
+			const Live_Segment* l = open_Live(pids[i]);
+			if (l == NULL)
+				continue;
+			if (read_Live(l, &segments[n]) == 0)
+				n++;
+			close_Live(l);
+		}
+
+		if (only && n == 0)
+		{
+			fprintf(stderr, "yash-top: %d: no live segment (set -o live in that shell)\n", only);
+			return 1;
+		}
+
+		if (iterations != 1 && isatty(STDOUT_FILENO))
+			printf("\033[H\033[J");
+		for (int i=0; i < n; i++)
+		{
+			print_Segment(&segments[i]);
+			printf("\n");
+		}
+		if (n == 0)
+			printf("no live shells (set -o live)\n");
+		fflush(stdout);
+
+		if (prom != NULL && save_Prometheus(prom, segments, n) == -1)
+			status = 1;
+	}
+
+	return status;
+}